@@ -0,0 +1,419 @@
+/*
+ * Filename: src/cmd/bench/bench.c
+ * Project: wdiff-align
+ * Brief: Measure the throughput of parsing, rendering, and both
+ *
+ * Description:
+ *   For each input file of wdiff output, measure separately:
+ *     parse    the scanner alone, breaking the input into spans;
+ *     render   the three-line renderer alone, fed spans that were
+ *              already found, with its output thrown away;
+ *     e2e      the whole of wdiff_align_file(), writing to /dev/null.
+ *
+ *   Each measurement is repeated, and the best time is kept.
+ *   Results are reported in MB/s and lines/s of input, on stdout,
+ *   and optionally appended to a file as JSON, one object per line,
+ *   so that results from one release can be compared with the next.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+    // Import clock_gettime()
+
+#include <errno.h>
+    // Import var errno
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdio.h>
+    // Import type FILE
+    // Import fclose()
+    // Import fopen()
+    // Import fprintf()
+    // Import printf()
+#include <stdlib.h>
+    // Import exit()
+    // Import free()
+#include <string.h>
+    // Import memchr()
+#include <time.h>
+    // Import clock_gettime()
+    // Import constant CLOCK_MONOTONIC
+#include <getopt.h>
+    // Import getopt_long()
+
+#include <cscript.h>
+#include "../wdiff-align.h"
+
+const char *program_path;
+const char *program_name;
+
+FILE *errprint_fh = NULL;
+FILE *dbgprint_fh = NULL;
+
+bool verbose = false;
+bool debug   = false;
+
+static bool   ctrl         = false;
+static bool   show_midline = false;
+static size_t repeat       = 3;
+static int    simd_level   = simd_auto;
+static const char *json_fname = NULL;
+
+static struct option long_options[] = {
+    {"help",           no_argument,       0,  'h'},
+    {"ctrl",           no_argument,       0,  'c'},
+    {"midline",        no_argument,       0,  'm'},
+    {"repeat",         required_argument, 0,  'r'},
+    {"simd",           required_argument, 0,  'X'},
+    {"json",           required_argument, 0,  'J'},
+    {0, 0, 0, 0}
+};
+
+static const char usage_text[] =
+    "Options:\n"
+    "  --help|-h            Show this help message and exit\n"
+    "  --ctrl|-c            Input uses control characters for markers\n"
+    "  --midline|-m         Render the middle line of +/- markers\n"
+    "  --repeat=N           Run each benchmark N times, keep the best\n"
+    "  --simd=LEVEL         Skip plain text using auto|avx2|sse2|scalar\n"
+    "  --json=FILE          Append results to FILE, one JSON object per line\n"
+    ;
+
+/*
+ * The result of one benchmark on one input.
+ */
+struct result {
+    const char *bench;
+    const char *fname;
+    size_t     bytes;
+    size_t     lines;
+    size_t     out_bytes;
+    double     seconds;
+};
+
+typedef struct result result_t;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static size_t
+count_lines(const char *buf, size_t len)
+{
+    const char *end = buf + len;
+    size_t n = 0;
+
+    while ((buf = memchr(buf, '\n', end - buf)) != NULL) {
+        ++n;
+        ++buf;
+    }
+    return (n);
+}
+
+/*
+ * Parse only:  find all spans, and do nothing with them.
+ */
+static size_t
+bench_parse(const input_t *in, const marker_dfa_t *dfa)
+{
+    scan_t scan;
+    span_t span;
+    size_t nspans = 0;
+
+    scan_init_mem(&scan, in->map, in->maplen, dfa);
+    while (scan_next(&scan, &span)) {
+        ++nspans;
+    }
+    scan_free(&scan);
+    return (nspans);
+}
+
+/*
+ * Collect all spans of a memory-mapped input.
+ * Spans point into the mapping, so they stay valid.
+ */
+static span_t *
+collect_spans(const input_t *in, const marker_dfa_t *dfa, size_t *countp)
+{
+    scan_t scan;
+    span_t *spanv = NULL;
+    size_t spanc = 0;
+    size_t spansz = 0;
+
+    scan_init_mem(&scan, in->map, in->maplen, dfa);
+    while (true) {
+        if (spanc == spansz) {
+            spansz = spansz ? 2 * spansz : 4096;
+            spanv = guard_realloc(spanv, spansz * sizeof (span_t));
+        }
+        if (!scan_next(&scan, &spanv[spanc])) {
+            break;
+        }
+        ++spanc;
+    }
+    scan_free(&scan);
+    *countp = spanc;
+    return (spanv);
+}
+
+/*
+ * Render only:  feed spans that were already found to the renderer.
+ * Output is kept in memory, and thrown away a batch at a time.
+ * Return the number of bytes of output.
+ */
+static size_t
+bench_render(const span_t *spanv, size_t spanc)
+{
+    align_t align;
+    size_t out_bytes = 0;
+    size_t i;
+
+    align_init(&align, NULL, true, show_midline);
+    for (i = 0; i < spanc; ++i) {
+        const span_t *sp = &spanv[i];
+
+        switch (sp->kind) {
+        case span_text:
+            align_text(&align, sp->ptr, sp->len);
+            break;
+        case span_eol:
+            align_eol(&align);
+            if (align.olen >= 64 * 1024) {
+                out_bytes += align.olen;
+                align.olen = 0;
+            }
+            break;
+        default:
+            align_marker(&align, sp->kind);
+            break;
+        }
+    }
+    align_finish(&align);
+    out_bytes += align.olen;
+    align_free(&align);
+    return (out_bytes);
+}
+
+static void
+report(const result_t *r, FILE *jsonf, const char *simd_name)
+{
+    double mb = r->bytes / 1e6;
+
+    printf("%-8s %-40s %9.1f MB/s %12.0f lines/s\n",
+        r->bench, r->fname, mb / r->seconds, r->lines / r->seconds);
+
+    if (jsonf == NULL) {
+        return;
+    }
+    fprintf(jsonf,
+        "{\"bench\": \"%s\", \"input\": \"%s\", \"markers\": \"%s\","
+        " \"midline\": %s, \"simd\": \"%s\","
+        " \"bytes\": %zu, \"lines\": %zu, \"out_bytes\": %zu,"
+        " \"seconds\": %.6f, \"mb_per_s\": %.2f, \"lines_per_s\": %.0f}\n",
+        r->bench, r->fname, ctrl ? "ctrl" : "std",
+        show_midline ? "true" : "false", simd_name,
+        r->bytes, r->lines, r->out_bytes,
+        r->seconds, mb / r->seconds, r->lines / r->seconds);
+}
+
+/*
+ * Run all benchmarks on one input file.
+ */
+static int
+bench_file(const char *fname, const marker_dfa_t *dfa, FILE *devnull,
+           FILE *jsonf, const char *simd_name)
+{
+    input_t in;
+    span_t *spanv;
+    size_t spanc;
+    result_t parse, render, e2e;
+    size_t i;
+    int err;
+
+    err = input_open(&in, fname);
+    if (err == 0 && in.map == NULL) {
+        input_close(&in);
+        err = EINVAL;
+    }
+    if (err) {
+        eprintf("%s: cannot map '%s'.\n", program_name, fname);
+        eexplain_err(err);
+        return (2);
+    }
+
+    parse.bench = "parse";
+    render.bench = "render";
+    e2e.bench = "e2e";
+    parse.fname = render.fname = e2e.fname = fname;
+    parse.bytes = render.bytes = e2e.bytes = in.maplen;
+    parse.lines = render.lines = e2e.lines = count_lines(in.map, in.maplen);
+    parse.out_bytes = 0;
+    parse.seconds = render.seconds = e2e.seconds = 1e30;
+
+    spanv = collect_spans(&in, dfa, &spanc);
+
+    for (i = 0; i < repeat; ++i) {
+        double t0, t1, t2, t3;
+
+        t0 = now();
+        bench_parse(&in, dfa);
+        t1 = now();
+        render.out_bytes = bench_render(spanv, spanc);
+        t2 = now();
+        err = wdiff_align_file(fname, devnull, dfa, true, show_midline, 0, false, format_text, false, NULL);
+        fflush(devnull);
+        t3 = now();
+        if (err) {
+            eprintf("%s: cannot read '%s'.\n", program_name, fname);
+            eexplain_err(err);
+            break;
+        }
+
+        if (t1 - t0 < parse.seconds) {
+            parse.seconds = t1 - t0;
+        }
+        if (t2 - t1 < render.seconds) {
+            render.seconds = t2 - t1;
+        }
+        if (t3 - t2 < e2e.seconds) {
+            e2e.seconds = t3 - t2;
+        }
+    }
+    e2e.out_bytes = render.out_bytes;
+
+    free(spanv);
+    input_close(&in);
+    if (err) {
+        return (2);
+    }
+
+    report(&parse, jsonf, simd_name);
+    report(&render, jsonf, simd_name);
+    report(&e2e, jsonf, simd_name);
+    return (0);
+}
+
+static void
+usage(void)
+{
+    eprintf("usage: %s [ <options> ] FILE...\n", program_name);
+    eprintf("%s", usage_text);
+}
+
+int
+main(int argc, char **argv)
+{
+    syntax_t markers[N_MARKERS];
+    marker_dfa_t dfa;
+    FILE *devnull;
+    FILE *jsonf;
+    const char *simd_name;
+    int optc;
+    int rv;
+    int i;
+
+    set_eprint_fh();
+    program_path = *argv;
+    program_name = sname(program_path);
+
+    while ((optc = getopt_long(argc, argv, "hcm", long_options, NULL)) != -1) {
+        switch (optc) {
+        case 'h':
+            fputs(usage_text, stdout);
+            exit(0);
+            break;
+        case 'c':
+            ctrl = true;
+            break;
+        case 'm':
+            show_midline = true;
+            break;
+        case 'r':
+            if (parse_cardinal(&repeat, optarg) != 0 || repeat == 0) {
+                eprintf("%s: invalid repeat count, '%s'\n",
+                    program_name, optarg);
+                exit(1);
+            }
+            break;
+        case 'X':
+            simd_level = simd_level_by_name(optarg);
+            if (simd_level < 0) {
+                eprintf("%s: unknown SIMD level, '%s'\n",
+                    program_name, optarg);
+                exit(1);
+            }
+            break;
+        case 'J':
+            json_fname = optarg;
+            break;
+        default:
+            usage();
+            exit(1);
+            break;
+        }
+    }
+
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    syntax_default(markers, ctrl);
+    marker_dfa_compile(&dfa, markers, N_MARKERS);
+    simd_name = simd_level_name(skip_select(&dfa, simd_level));
+
+    devnull = fopen("/dev/null", "w");
+    if (devnull == NULL) {
+        int err = errno;
+        eprintf("%s: fopen('/dev/null') failed.\n", program_name);
+        eexplain_err(err);
+        exit(2);
+    }
+
+    jsonf = NULL;
+    if (json_fname != NULL) {
+        jsonf = fopen(json_fname, "a");
+        if (jsonf == NULL) {
+            int err = errno;
+            eprintf("%s: fopen('%s') failed.\n", program_name, json_fname);
+            eexplain_err(err);
+            exit(2);
+        }
+    }
+
+    rv = 0;
+    for (i = optind; i < argc; ++i) {
+        if (bench_file(argv[i], &dfa, devnull, jsonf, simd_name) != 0) {
+            rv = 2;
+        }
+    }
+
+    if (jsonf != NULL) {
+        fclose(jsonf);
+    }
+    fclose(devnull);
+    marker_dfa_free(&dfa);
+    exit(rv);
+}
@@ -0,0 +1,261 @@
+/*
+ * Filename: src/cmd/bench/gen-wdiff.c
+ * Project: wdiff-align
+ * Brief: Generate synthetic wdiff output, for benchmarks
+ *
+ * Description:
+ *   Write lines of random words, some of them marked as deleted,
+ *   inserted, or replaced, just as wdiff would mark them.
+ *   The line length, the fraction of words that are changed,
+ *   the style of markers, and the total size can all be chosen,
+ *   so that the cost of parsing and rendering can be measured
+ *   over a range of inputs.  The same seed always gives the same output.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+    // Import fputs()
+    // Import fwrite()
+    // Import var stdout
+#include <stdlib.h>
+    // Import exit()
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+    // Import strlen()
+#include <getopt.h>
+    // Import getopt_long()
+
+#include <cscript.h>
+
+const char *program_path;
+const char *program_name;
+
+FILE *errprint_fh = NULL;
+FILE *dbgprint_fh = NULL;
+
+bool verbose = false;
+bool debug   = false;
+
+static size_t line_length = 80;
+static size_t density     = 10;
+static size_t total_size  = 16 * 1024 * 1024;
+static size_t seed        = 1;
+static bool   ctrl        = false;
+
+static struct option long_options[] = {
+    {"help",           no_argument,       0,  'h'},
+    {"line-length",    required_argument, 0,  'l'},
+    {"density",        required_argument, 0,  'p'},
+    {"size",           required_argument, 0,  'n'},
+    {"seed",           required_argument, 0,  'S'},
+    {"ctrl",           no_argument,       0,  'c'},
+    {0, 0, 0, 0}
+};
+
+static const char usage_text[] =
+    "Options:\n"
+    "  --help|-h            Show this help message and exit\n"
+    "  --line-length=N      Make lines about N bytes long (default 80)\n"
+    "  --density=PCT        Change about PCT percent of words (default 10)\n"
+    "  --size=N             Write about N bytes in all (default 16 MiB)\n"
+    "  --seed=N             Seed for the random words (default 1)\n"
+    "  --ctrl|-c            Use control characters for markers,\n"
+    "                       as with wdiff-align --ctrl\n"
+    ;
+
+static const char *markers_std[]  = { "{+", "+}", "[-", "-]" };
+static const char *markers_ctrl[] = { "\x1c", "\x1d", "\x1e", "\x1f" };
+
+static uint64_t rng_state;
+
+/*
+ * xorshift64* -- fast, and good enough to make words.
+ */
+static inline uint64_t
+rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL);
+}
+
+static inline size_t
+rng_below(size_t n)
+{
+    return ((size_t)((rng_next() >> 11) % n));
+}
+
+/*
+ * Append a random word, of 1 to 10 characters, some of which
+ * are punctuation, as in source code.  Return its length.
+ */
+static size_t
+put_word(char *op)
+{
+    static const char chars[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+        "abcdefghijklmnopqrstuvwxyz_()<>.,;=$";
+    size_t len = 1 + rng_below(10);
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        op[i] = chars[rng_below(sizeof (chars) - 1)];
+    }
+    return (len);
+}
+
+static size_t
+put_str(char *op, const char *str)
+{
+    size_t len = strlen(str);
+
+    memcpy(op, str, len);
+    return (len);
+}
+
+/*
+ * Build one line, of about |line_length| bytes, at |op|.
+ * A changed word is deleted, inserted, or replaced,
+ * with equal probability.  Return the length of the line.
+ */
+static size_t
+gen_line(char *op, const char **mk)
+{
+    char *start = op;
+
+    while ((size_t)(op - start) < line_length) {
+        if (op != start) {
+            *op++ = ' ';
+        }
+        if (rng_below(100) >= density) {
+            op += put_word(op);
+            continue;
+        }
+        switch (rng_below(3)) {
+        case 0:
+            op += put_str(op, mk[2]);
+            op += put_word(op);
+            op += put_str(op, mk[3]);
+            break;
+        case 1:
+            op += put_str(op, mk[0]);
+            op += put_word(op);
+            op += put_str(op, mk[1]);
+            break;
+        default:
+            op += put_str(op, mk[2]);
+            op += put_word(op);
+            op += put_str(op, mk[3]);
+            op += put_str(op, mk[0]);
+            op += put_word(op);
+            op += put_str(op, mk[1]);
+            break;
+        }
+    }
+    *op++ = '\n';
+    return (op - start);
+}
+
+static void
+usage(void)
+{
+    eprintf("usage: %s [ <options> ]\n", program_name);
+    eprintf("%s", usage_text);
+}
+
+static void
+parse_size_opt(size_t *r, const char *name, const char *arg)
+{
+    if (parse_cardinal(r, arg) != 0) {
+        eprintf("%s: invalid %s, '%s'\n", program_name, name, arg);
+        usage();
+        exit(1);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    const char **mk;
+    char *line;
+    size_t total;
+    int optc;
+
+    set_eprint_fh();
+    program_path = *argv;
+    program_name = sname(program_path);
+
+    while ((optc = getopt_long(argc, argv, "hc", long_options, NULL)) != -1) {
+        switch (optc) {
+        case 'h':
+            fputs(usage_text, stdout);
+            exit(0);
+            break;
+        case 'l':
+            parse_size_opt(&line_length, "line length", optarg);
+            break;
+        case 'p':
+            parse_size_opt(&density, "density", optarg);
+            break;
+        case 'n':
+            parse_size_opt(&total_size, "size", optarg);
+            break;
+        case 'S':
+            parse_size_opt(&seed, "seed", optarg);
+            break;
+        case 'c':
+            ctrl = true;
+            break;
+        default:
+            usage();
+            exit(1);
+            break;
+        }
+    }
+
+    if (density > 100 || line_length == 0) {
+        usage();
+        exit(1);
+    }
+
+    rng_state = seed ? seed : 1;
+    mk = ctrl ? markers_ctrl : markers_std;
+
+    // The longest word, with a replacement, is well under 32 bytes.
+    line = guard_malloc(line_length + 32);
+
+    total = 0;
+    while (total < total_size) {
+        size_t len = gen_line(line, mk);
+
+        fwrite(line, 1, len, stdout);
+        total += len;
+    }
+
+    free(line);
+    exit(0);
+}
@@ -0,0 +1,732 @@
+/*
+ * Filename: src/cmd/cache.c
+ * Project: wdiff-align
+ * Brief: On-disk cache of rendered pairs, for --series --cache=FILE
+ *
+ * Description:
+ *   Re-running --series over a history that only ever grows
+ *   diffs the same pairs of lines, with the same options, every time.
+ *   The cache keeps the rendered output of each pair, keyed by a
+ *   128-bit hash of the options and of both lines, so that a re-run
+ *   only diffs the pairs that are new.
+ *
+ *   The cache file is a header followed by records, each one a key,
+ *   the number of the last run that used it, the options and both
+ *   lines, and the rendered output.  The hash only finds a record;
+ *   it is a hit only if its options and lines are the same as those
+ *   looked up, so a collision costs a diff, never wrong output.
+ *   Records are only ever appended;  the only writes in place are
+ *   the run number in the header, and the last-used run number
+ *   of a record, on a hit.  The file is memory-mapped when it is opened,
+ *   and its keys are indexed in a hash table in memory.
+ *
+ *   If the file is larger than its cap when it is closed, it is
+ *   rewritten with the most recently used records, to 3/4 of the cap,
+ *   and renamed into place.  The file is locked while it is in use;
+ *   a run that finds it locked by another does not wait for it,
+ *   but goes without the cache.
+ *
+ *   The file is in native byte order;  it is a cache, not an archive.
+ *   A record cut short by a crash is dropped.  A cache in an older
+ *   format is started over.  A file that is not a cache is left alone.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+    // Import flock()
+    // Import pread()
+    // Import pwrite()
+
+#include <errno.h>
+    // Import var errno
+    // Import constant EWOULDBLOCK
+#include <fcntl.h>
+    // Import open()
+    // Import constant O_CREAT
+    // Import constant O_RDWR
+#include <stdint.h>
+    // Import type uint32_t
+    // Import type uint64_t
+#include <stdio.h>
+    // Import fprintf()
+    // Import rename()
+    // Import snprintf()
+#include <stdlib.h>
+    // Import free()
+    // Import qsort()
+#include <string.h>
+    // Import memcmp()
+    // Import memcpy()
+    // Import memset()
+    // Import strlen()
+#include <sys/file.h>
+    // Import flock()
+    // Import constant LOCK_EX
+    // Import constant LOCK_NB
+#include <sys/mman.h>
+    // Import mmap()
+    // Import munmap()
+#include <sys/stat.h>
+    // Import fstat()
+    // Import stat()
+    // Import type struct stat
+#include <unistd.h>
+    // Import close()
+    // Import ftruncate()
+    // Import pread()
+    // Import pwrite()
+    // Import unlink()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+/*
+ * The last byte is the version.  A cache of any other version
+ * is started over:  records of version 1 had no text to check
+ * a hit against, and those of version 2 have colors that end
+ * without an erase to end of line.
+ */
+static const char cache_magic[8] = "WDACACH3";
+
+#define CACHE_MAGIC_PREFIX (sizeof (cache_magic) - 1)
+
+/*
+ * The file header, and the header of each record.
+ * Both are a multiple of 8 bytes, and so are records,
+ * so that every record header is aligned in the mapping.
+ * A record header is followed by the |klen| bytes that were hashed
+ * for the key, then by the |len| bytes of output.
+ */
+struct cache_hdr {
+    char     magic[8];
+    uint64_t run;
+};
+
+struct cache_rec {
+    uint64_t key[2];
+    uint64_t used;
+    uint32_t klen;
+    uint32_t len;
+};
+
+#define REC_SIZE(klen, len) \
+    (sizeof (struct cache_rec) + (((klen) + (len) + 7) & ~(size_t)7))
+
+// ==================== Hash
+
+/*
+ * MurmurHash3, x64 128-bit variant, by Austin Appleby,
+ * who placed it in the public domain.
+ */
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+    return ((x << r) | (x >> (64 - r)));
+}
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (k);
+}
+
+static void
+murmur3_128(const void *data, size_t len, uint64_t seed, uint64_t out[2])
+{
+    const unsigned char *p = data;
+    const size_t nblocks = len / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+    uint64_t k1, k2;
+    size_t i;
+
+    for (i = 0; i < nblocks; ++i) {
+        memcpy(&k1, p + i * 16, 8);
+        memcpy(&k2, p + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    p += nblocks * 16;
+    k1 = 0;
+    k2 = 0;
+    switch (len & 15) {
+    case 15: k2 ^= (uint64_t)p[14] << 48;  // FALLTHROUGH
+    case 14: k2 ^= (uint64_t)p[13] << 40;  // FALLTHROUGH
+    case 13: k2 ^= (uint64_t)p[12] << 32;  // FALLTHROUGH
+    case 12: k2 ^= (uint64_t)p[11] << 24;  // FALLTHROUGH
+    case 11: k2 ^= (uint64_t)p[10] << 16;  // FALLTHROUGH
+    case 10: k2 ^= (uint64_t)p[9] << 8;    // FALLTHROUGH
+    case  9: k2 ^= (uint64_t)p[8];
+             k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+             // FALLTHROUGH
+    case  8: k1 ^= (uint64_t)p[7] << 56;   // FALLTHROUGH
+    case  7: k1 ^= (uint64_t)p[6] << 48;   // FALLTHROUGH
+    case  6: k1 ^= (uint64_t)p[5] << 40;   // FALLTHROUGH
+    case  5: k1 ^= (uint64_t)p[4] << 32;   // FALLTHROUGH
+    case  4: k1 ^= (uint64_t)p[3] << 24;   // FALLTHROUGH
+    case  3: k1 ^= (uint64_t)p[2] << 16;   // FALLTHROUGH
+    case  2: k1 ^= (uint64_t)p[1] << 8;    // FALLTHROUGH
+    case  1: k1 ^= (uint64_t)p[0];
+             k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+/**
+ * @brief Compute the key of a pair of texts, rendered with some options.
+ * @param c     IN/OUT  The cache;  only its scratch buffer is used.
+ * @param key   OUT     The key.
+ * @param opts  IN      The options, as a string.
+ * @param s1    IN      The "before" text.
+ * @param len1  IN      Length of |s1|.
+ * @param s2    IN      The "after" text.
+ * @param len2  IN      Length of |s2|.
+ * @return void
+ *
+ * Each part is preceded by its length, so that no two different
+ * triples hash the same bytes.  The bytes hashed are kept, until
+ * the next call, for cache_get() to check a hit against, and for
+ * cache_put() to store.
+ */
+void
+cache_key(cache_t *c, uint64_t key[2], const char *opts,
+          const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    size_t olen = strlen(opts);
+    uint64_t lens[3];
+    size_t need;
+    char *p;
+
+    need = sizeof (lens) + olen + len1 + len2;
+    if (need > c->ksz) {
+        c->ksz = need * 2;
+        free(c->kbuf);
+        c->kbuf = guard_malloc(c->ksz);
+    }
+    lens[0] = olen;
+    lens[1] = len1;
+    lens[2] = len2;
+    p = c->kbuf;
+    memcpy(p, lens, sizeof (lens));
+    p += sizeof (lens);
+    memcpy(p, opts, olen);
+    p += olen;
+    memcpy(p, s1, len1);
+    p += len1;
+    memcpy(p, s2, len2);
+    murmur3_128(c->kbuf, need, 0, key);
+    c->klen = need;
+}
+
+// ==================== Index
+
+/*
+ * Add a record to the index, growing the hash table to keep
+ * it at most half full.  A record with a key that is already
+ * in the index replaces it.
+ */
+static void
+index_add(cache_t *c, const uint64_t key[2], uint64_t off,
+          size_t klen, size_t len, uint64_t used)
+{
+    cache_ent_t *ent;
+    size_t h;
+
+    if (2 * (c->entc + 1) > c->slotsz) {
+        size_t nsz = c->slotsz ? 2 * c->slotsz : 1024;
+        size_t i;
+
+        free(c->slotv);
+        c->slotv = guard_calloc(nsz, sizeof (size_t));
+        c->slotsz = nsz;
+        for (i = 0; i < c->entc; ++i) {
+            h = c->entv[i].key[0] & (nsz - 1);
+            while (c->slotv[h] != 0) {
+                h = (h + 1) & (nsz - 1);
+            }
+            c->slotv[h] = i + 1;
+        }
+    }
+
+    h = key[0] & (c->slotsz - 1);
+    while (c->slotv[h] != 0) {
+        ent = &c->entv[c->slotv[h] - 1];
+        if (ent->key[0] == key[0] && ent->key[1] == key[1]) {
+            ent->off = off;
+            ent->klen = klen;
+            ent->len = len;
+            ent->used = used;
+            return;
+        }
+        h = (h + 1) & (c->slotsz - 1);
+    }
+
+    if (c->entc == c->entsz) {
+        c->entsz = c->entsz ? 2 * c->entsz : 1024;
+        c->entv = guard_realloc(c->entv, c->entsz * sizeof (cache_ent_t));
+    }
+    ent = &c->entv[c->entc];
+    ent->key[0] = key[0];
+    ent->key[1] = key[1];
+    ent->off = off;
+    ent->klen = klen;
+    ent->len = len;
+    ent->used = used;
+    c->slotv[h] = ++c->entc;
+}
+
+static cache_ent_t *
+index_find(const cache_t *c, const uint64_t key[2])
+{
+    size_t h;
+
+    if (c->slotsz == 0) {
+        return (NULL);
+    }
+    h = key[0] & (c->slotsz - 1);
+    while (c->slotv[h] != 0) {
+        cache_ent_t *ent = &c->entv[c->slotv[h] - 1];
+
+        if (ent->key[0] == key[0] && ent->key[1] == key[1]) {
+            return (ent);
+        }
+        h = (h + 1) & (c->slotsz - 1);
+    }
+    return (NULL);
+}
+
+// ==================== Open and close
+
+/*
+ * Read the records of the mapped file into the index.
+ * Return the length of the file up to the last whole record.
+ */
+static size_t
+load_records(cache_t *c)
+{
+    size_t off = sizeof (struct cache_hdr);
+
+    while (off + sizeof (struct cache_rec) <= c->maplen) {
+        const struct cache_rec *rec = (const struct cache_rec *)(c->map + off);
+
+        if (off + REC_SIZE(rec->klen, rec->len) > c->maplen) {
+            break;
+        }
+        index_add(c, rec->key, off, rec->klen, rec->len, rec->used);
+        off += REC_SIZE(rec->klen, rec->len);
+    }
+    return (off);
+}
+
+/*
+ * Open and lock the cache file.  If another run has it locked,
+ * fail with EWOULDBLOCK, rather than wait for it.  If it was replaced
+ * by another run between opening and locking it, open the new one instead.
+ */
+static int
+open_locked(const char *fname)
+{
+    while (true) {
+        struct stat st1, st2;
+        int fd;
+
+        fd = open(fname, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return (-1);
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st1) != 0) {
+            int err = errno;
+
+            close(fd);
+            errno = err;
+            return (-1);
+        }
+        if (stat(fname, &st2) == 0 && st1.st_ino == st2.st_ino && st1.st_dev == st2.st_dev) {
+            return (fd);
+        }
+        close(fd);
+    }
+}
+
+/**
+ * @brief Open a cache file, creating it if need be.
+ * @param c      OUT  The cache.
+ * @param fname  IN   File name.
+ * @param max    IN   Size cap of the file, in bytes.
+ * @return 0 on success, else an errno value;
+ *         EWOULDBLOCK if another run is using the cache.
+ */
+int
+cache_open(cache_t *c, const char *fname, size_t max)
+{
+    struct cache_hdr hdr;
+    struct stat st;
+    size_t end;
+
+    memset(c, 0, sizeof (*c));
+    c->fname = fname;
+    c->max = max;
+    c->fd = open_locked(fname);
+    if (c->fd < 0 || fstat(c->fd, &st) != 0) {
+        int err = errno;
+
+        if (c->fd >= 0) {
+            close(c->fd);
+        }
+        return (err);
+    }
+
+    if ((size_t)st.st_size >= sizeof (hdr)) {
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+
+        if (map != MAP_FAILED) {
+            c->map = map;
+            c->maplen = st.st_size;
+        }
+    }
+
+    if (c->map != NULL && memcmp(c->map, cache_magic, sizeof (cache_magic)) == 0) {
+        memcpy(&hdr, c->map, sizeof (hdr));
+        end = load_records(c);
+    }
+    else if (st.st_size == 0
+             || (c->map != NULL && memcmp(c->map, cache_magic, CACHE_MAGIC_PREFIX) == 0)) {
+        memcpy(hdr.magic, cache_magic, sizeof (cache_magic));
+        hdr.run = 0;
+        end = sizeof (hdr);
+    }
+    else {
+        // Never write over a file that is not a cache.
+        cache_close(c);
+        return (EINVAL);
+    }
+
+    // Drop anything after the last whole record.
+    if (end != (size_t)st.st_size && ftruncate(c->fd, end) != 0) {
+        int err = errno;
+
+        cache_close(c);
+        return (err);
+    }
+    if (c->maplen > end) {
+        c->maplen = end;
+    }
+    c->size = end;
+
+    c->run = ++hdr.run;
+    if (pwrite(c->fd, &hdr, sizeof (hdr), 0) != sizeof (hdr)) {
+        int err = errno;
+
+        cache_close(c);
+        return (err);
+    }
+    return (0);
+}
+
+static int
+cmp_used(const void *p1, const void *p2)
+{
+    const cache_ent_t *e1 = *(const cache_ent_t * const *)p1;
+    const cache_ent_t *e2 = *(const cache_ent_t * const *)p2;
+
+    // Most recently used first;  then the most recently written.
+    if (e1->used != e2->used) {
+        return (e1->used > e2->used ? -1 : 1);
+    }
+    return (e1->off > e2->off ? -1 : e1->off < e2->off);
+}
+
+static int
+cmp_off(const void *p1, const void *p2)
+{
+    const cache_ent_t *e1 = *(const cache_ent_t * const *)p1;
+    const cache_ent_t *e2 = *(const cache_ent_t * const *)p2;
+
+    return (e1->off < e2->off ? -1 : e1->off > e2->off);
+}
+
+/*
+ * Rewrite the cache file with the most recently used records
+ * that fit in 3/4 of the cap, and rename it into place.
+ * Records that have been replaced are dropped on the way.
+ */
+static void
+compact(cache_t *c)
+{
+    struct cache_hdr hdr;
+    cache_ent_t **keepv;
+    size_t keepc;
+    size_t total;
+    char *tmpname;
+    size_t tmplen;
+    char *buf = NULL;
+    size_t bufsz = 0;
+    uint64_t off;
+    size_t i;
+    int fd;
+
+    keepv = guard_malloc((c->entc + 1) * sizeof (cache_ent_t *));
+    for (i = 0; i < c->entc; ++i) {
+        keepv[i] = &c->entv[i];
+    }
+    qsort(keepv, c->entc, sizeof (cache_ent_t *), cmp_used);
+    total = sizeof (hdr);
+    for (keepc = 0; keepc < c->entc; ++keepc) {
+        if (total + REC_SIZE(keepv[keepc]->klen, keepv[keepc]->len) > c->max / 4 * 3) {
+            break;
+        }
+        total += REC_SIZE(keepv[keepc]->klen, keepv[keepc]->len);
+    }
+    // Keep the records in the order they were first written.
+    qsort(keepv, keepc, sizeof (cache_ent_t *), cmp_off);
+
+    tmplen = strlen(c->fname) + 5;
+    tmpname = guard_malloc(tmplen);
+    snprintf(tmpname, tmplen, "%s.tmp", c->fname);
+    fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmpname);
+        free(keepv);
+        return;
+    }
+
+    memcpy(hdr.magic, cache_magic, sizeof (cache_magic));
+    hdr.run = c->run;
+    off = 0;
+    if (pwrite(fd, &hdr, sizeof (hdr), off) != sizeof (hdr)) {
+        goto fail;
+    }
+    off += sizeof (hdr);
+    for (i = 0; i < keepc; ++i) {
+        size_t rsz = REC_SIZE(keepv[i]->klen, keepv[i]->len);
+
+        if (rsz > bufsz) {
+            bufsz = rsz * 2;
+            free(buf);
+            buf = guard_malloc(bufsz);
+        }
+        if (pread(c->fd, buf, rsz, keepv[i]->off) != (ssize_t)rsz
+            || pwrite(fd, buf, rsz, off) != (ssize_t)rsz) {
+            goto fail;
+        }
+        off += rsz;
+    }
+    if (close(fd) != 0 || rename(tmpname, c->fname) != 0) {
+        unlink(tmpname);
+    }
+    else {
+        c->evicted = c->entc - keepc;
+        c->size = off;
+        c->entc = keepc;
+    }
+    free(buf);
+    free(tmpname);
+    free(keepv);
+    return;
+
+fail:
+    close(fd);
+    unlink(tmpname);
+    free(buf);
+    free(tmpname);
+    free(keepv);
+}
+
+/**
+ * @brief Close the cache file, and trim it to its cap if it is over.
+ * @param c  IN/OUT  The cache.
+ * @return void
+ */
+void
+cache_close(cache_t *c)
+{
+    if (c->fd >= 0 && c->size > c->max) {
+        compact(c);
+    }
+    if (c->map != NULL) {
+        munmap(c->map, c->maplen);
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    free(c->entv);
+    free(c->slotv);
+    free(c->kbuf);
+    free(c->rbuf);
+    c->map = NULL;
+    c->fd = -1;
+    c->entv = NULL;
+    c->slotv = NULL;
+    c->kbuf = NULL;
+    c->rbuf = NULL;
+}
+
+// ==================== Get and put
+
+/**
+ * @brief Look up the rendered output for a key.
+ * @param c     IN/OUT  The cache.
+ * @param key   IN      The key, from the last call to cache_key().
+ * @param lenp  OUT     Length of the output.
+ * @return The output, valid until the next call, or NULL if it is not cached.
+ *
+ * A record with the same key is a hit only if the options and lines
+ * stored in it are the same as those given to cache_key().
+ * A hit marks the record as used in this run.
+ */
+const char *
+cache_get(cache_t *c, const uint64_t key[2], size_t *lenp)
+{
+    cache_ent_t *ent = index_find(c, key);
+    bool mapped;
+    const char *text;
+
+    if (ent == NULL || ent->klen != c->klen) {
+        ++c->misses;
+        return (NULL);
+    }
+
+    mapped = ent->off + REC_SIZE(ent->klen, ent->len) <= c->maplen;
+    if (mapped) {
+        text = c->map + ent->off + sizeof (struct cache_rec);
+    }
+    else {
+        // Written during this run, after the file was mapped
+        size_t need = ent->klen + ent->len;
+
+        if (need > c->rsz) {
+            c->rsz = need * 2;
+            free(c->rbuf);
+            c->rbuf = guard_malloc(c->rsz);
+        }
+        if (pread(c->fd, c->rbuf, need, ent->off + sizeof (struct cache_rec))
+            != (ssize_t)need) {
+            ++c->misses;
+            return (NULL);
+        }
+        text = c->rbuf;
+    }
+    if (memcmp(text, c->kbuf, c->klen) != 0) {
+        // The same hash, for other lines
+        ++c->misses;
+        return (NULL);
+    }
+
+    if (mapped) {
+        ((struct cache_rec *)(c->map + ent->off))->used = c->run;
+    }
+    ent->used = c->run;
+    ++c->hits;
+    *lenp = ent->len;
+    return (text + ent->klen);
+}
+
+/**
+ * @brief Append the rendered output for a key to the cache.
+ * @param c     IN/OUT  The cache.
+ * @param key   IN      The key, from the last call to cache_key().
+ * @param data  IN      The rendered output.
+ * @param len   IN      Its length.
+ * @return void
+ *
+ * A write that fails is not an error;  the pair is just not cached,
+ * and neither is any other, for the rest of the run.  If the failed
+ * write cannot be undone, the file is left to grow past it, so that
+ * nothing is written over it;  the next run drops it, and anything
+ * after it, if it is not a whole record.
+ */
+void
+cache_put(cache_t *c, const uint64_t key[2], const char *data, size_t len)
+{
+    struct cache_rec rec;
+    static const char zeros[8];
+    size_t klen = c->klen;
+    size_t rsz = REC_SIZE(klen, len);
+    size_t pad = rsz - sizeof (rec) - klen - len;
+
+    if (klen > UINT32_MAX || len > UINT32_MAX || rsz > c->max) {
+        return;
+    }
+    rec.key[0] = key[0];
+    rec.key[1] = key[1];
+    rec.used = c->run;
+    rec.klen = klen;
+    rec.len = len;
+    if (c->failed) {
+        return;
+    }
+    if (pwrite(c->fd, &rec, sizeof (rec), c->size) != sizeof (rec)
+        || pwrite(c->fd, c->kbuf, klen, c->size + sizeof (rec)) != (ssize_t)klen
+        || pwrite(c->fd, data, len, c->size + sizeof (rec) + klen) != (ssize_t)len
+        || pwrite(c->fd, zeros, pad, c->size + sizeof (rec) + klen + len) != (ssize_t)pad) {
+        // Leave nothing half-written, and stop adding to the file.
+        c->failed = true;
+        if (ftruncate(c->fd, c->size) != 0) {
+            c->size += rsz;
+        }
+        return;
+    }
+    index_add(c, key, c->size, klen, len, c->run);
+    c->size += rsz;
+    ++c->stores;
+}
+
+/**
+ * @brief Show how well the cache did, for --cache-stats.
+ * @param f  IN  Write here, usually stderr.
+ * @param c  IN  The cache.
+ * @return void
+ */
+void
+cache_print_stats(FILE *f, const cache_t *c)
+{
+    size_t lookups = c->hits + c->misses;
+
+    fprintf(f, "Cache:            %s\n", c->fname);
+    fprintf(f, "  lookups         %zu\n", lookups);
+    fprintf(f, "  hits            %zu\n", c->hits);
+    fprintf(f, "  misses          %zu\n", c->misses);
+    fprintf(f, "  hit rate        %.1f%%\n",
+        lookups ? 100.0 * c->hits / lookups : 0.0);
+    fprintf(f, "  stored          %zu\n", c->stores);
+    fprintf(f, "  records         %zu\n", c->entc);
+    fprintf(f, "  bytes           %zu of %zu\n", c->size, c->max);
+    fprintf(f, "  evicted         %zu\n", c->evicted);
+}
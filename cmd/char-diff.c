@@ -0,0 +1,331 @@
+/*
+ * Filename: src/cmd/char-diff.c
+ * Project: wdiff-align
+ * Brief: Character-level diff of a changed word pair, for --fine
+ *
+ * Description:
+ *   wdiff, and the native word diff, mark whole words as changed.
+ *   Where a deleted run is next to an inserted run, a character-level
+ *   diff of the two can show just the characters that changed.
+ *
+ *   The longest common subsequence is found with the bit-parallel
+ *   algorithm of Crochemore et al. and Hyyrö, "Bit-Parallel LCS-length
+ *   Computation Revisited" (2004):  one column of the dynamic
+ *   programming matrix is a bit-vector, 64 characters of the "before"
+ *   text per machine word, and each character of the "after" text
+ *   takes one add, one subtract and a few logical operations per word.
+ *   For a word pair, that is one machine word, and the cost is linear
+ *   in the length of the "after" text.
+ *
+ *   Each column is kept, so that an alignment can be traced back.
+ *   The texts are compared back to front, so that the trace back runs
+ *   front to back and, where there is a choice, puts deletions first,
+ *   as wdiff does.
+ *
+ *   A character is a UTF-8 sequence, so that a change never splits one.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+    // Import constant NULL
+    // Import type size_t
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memset()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+// A byte that is not valid UTF-8 is a character of its own, above Unicode.
+
+#define BAD_BYTE 0x110000UL
+
+static void *
+vec_reserve(void *vec, size_t *szp, size_t nelem, size_t elsz)
+{
+    size_t nsz;
+
+    if (nelem <= *szp) {
+        return (vec);
+    }
+    nsz = *szp ? *szp : 64;
+    while (nsz < nelem) {
+        nsz *= 2;
+    }
+    *szp = nsz;
+    return (guard_realloc(vec, nsz * elsz));
+}
+
+/*
+ * Split |str| into characters, with the byte offset of each.
+ * Return the number of characters, or FINE_MAX + 1 if there
+ * are more than FINE_MAX of them.
+ */
+static size_t
+decode(char_diff_t *cd, int side, const char *str, size_t len)
+{
+    unsigned long *chv;
+    size_t *offv;
+    size_t chc = 0;
+    size_t pos = 0;
+
+    cd->chv[side] = vec_reserve(cd->chv[side], &cd->chsz[side], FINE_MAX + 1, sizeof (unsigned long));
+    cd->offv[side] = vec_reserve(cd->offv[side], &cd->offsz[side], FINE_MAX + 2, sizeof (size_t));
+    chv = cd->chv[side];
+    offv = cd->offv[side];
+
+    while (pos < len) {
+        unsigned long ucs = str[pos] & 0xff;
+        size_t n = 1;
+
+        if (chc == FINE_MAX) {
+            return (FINE_MAX + 1);
+        }
+        if (ucs >= 0x80) {
+            n = utf8_decode(str + pos, len - pos, &ucs);
+            if (ucs == 0) {
+                ucs = BAD_BYTE + (str[pos] & 0xff);
+            }
+        }
+        chv[chc] = ucs;
+        offv[chc] = pos;
+        ++chc;
+        pos += n;
+    }
+    offv[chc] = len;
+    return (chc);
+}
+
+/*
+ * Build the match masks of the "before" text, reversed:
+ * bit i of the mask of a character is set if it is character
+ * m - 1 - i of the text.  ASCII characters have a table of their own;
+ * all others are looked up in a small open-addressed hash table.
+ */
+static void
+build_masks(char_diff_t *cd, size_t m, size_t nw)
+{
+    const unsigned long *chv = cd->chv[0];
+    size_t hsz;
+    size_t i;
+
+    hsz = 16;
+    while (hsz < 2 * m) {
+        hsz *= 2;
+    }
+    cd->hmask = hsz - 1;
+    cd->hashv = vec_reserve(cd->hashv, &cd->hashsz, hsz, sizeof (size_t));
+    memset(cd->hashv, 0, hsz * sizeof (size_t));
+
+    // 128 ASCII masks, m other masks at most, and one of all zeros
+    cd->peqv = vec_reserve(cd->peqv, &cd->peqsz, (128 + m + 1) * nw, sizeof (uint64_t));
+    memset(cd->peqv, 0, (128 + m + 1) * nw * sizeof (uint64_t));
+    cd->nsym = 0;
+
+    for (i = 0; i < m; ++i) {
+        unsigned long c = chv[m - 1 - i];
+        uint64_t *peq;
+
+        if (c < 128) {
+            peq = cd->peqv + c * nw;
+        }
+        else {
+            size_t h = (c * 2654435761UL) & cd->hmask;
+
+            while (cd->hashv[h] != 0 && cd->symv[cd->hashv[h] - 1] != c) {
+                h = (h + 1) & cd->hmask;
+            }
+            if (cd->hashv[h] == 0) {
+                cd->symv[cd->nsym] = c;
+                cd->hashv[h] = ++cd->nsym;
+            }
+            peq = cd->peqv + (128 + cd->hashv[h]) * nw;
+        }
+        peq[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+}
+
+static inline const uint64_t *
+lookup_mask(const char_diff_t *cd, unsigned long c, size_t nw)
+{
+    size_t h;
+
+    if (c < 128) {
+        return (cd->peqv + c * nw);
+    }
+    h = (c * 2654435761UL) & cd->hmask;
+    while (cd->hashv[h] != 0) {
+        if (cd->symv[cd->hashv[h] - 1] == c) {
+            return (cd->peqv + (128 + cd->hashv[h]) * nw);
+        }
+        h = (h + 1) & cd->hmask;
+    }
+    // The mask of all zeros, for a character not in the "before" text
+    return (cd->peqv + 128 * nw);
+}
+
+static void
+push_edit(char_diff_t *cd, int op, const char *text, size_t len)
+{
+    size_t editc = cd->editc;
+
+    if (editc != 0 && cd->editv[editc - 1].op == op
+        && cd->editv[editc - 1].text + cd->editv[editc - 1].len == text) {
+        cd->editv[editc - 1].len += len;
+        return;
+    }
+    if (editc >= cd->editsz) {
+        cd->editv = vec_reserve(cd->editv, &cd->editsz, editc + 1, sizeof (edit_t));
+    }
+    cd->editv[editc].op = op;
+    cd->editv[editc].text = text;
+    cd->editv[editc].len = len;
+    cd->editc = editc + 1;
+}
+
+void
+char_diff_init(char_diff_t *cd)
+{
+    memset(cd, 0, sizeof (*cd));
+}
+
+void
+char_diff_free(char_diff_t *cd)
+{
+    free(cd->chv[0]);
+    free(cd->chv[1]);
+    free(cd->offv[0]);
+    free(cd->offv[1]);
+    free(cd->peqv);
+    free(cd->symv);
+    free(cd->hashv);
+    free(cd->colv);
+    free(cd->editv);
+    char_diff_init(cd);
+}
+
+/**
+ * @brief Compute a character-level edit script that transforms |s1| into |s2|.
+ * @param cd    IN/OUT  Reusable working storage; holds the result.
+ * @param s1    IN      The deleted text.
+ * @param len1  IN      Length of |s1|.
+ * @param s2    IN      The inserted text.
+ * @param len2  IN      Length of |s2|.
+ * @return The number of edits in |cd->editv|, or 0 if the two texts
+ *         are not worth showing character by character.
+ *
+ * The texts are not worth it if either is longer than FINE_MAX
+ * characters, or if they have fewer characters in common than half
+ * the length of the longer one;  a few scattered characters in common
+ * are more confusing than helpful.
+ *
+ * The edit script points into |s1| and |s2|.
+ */
+size_t
+char_diff(char_diff_t *cd, const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    const unsigned long *av, *bv;
+    const size_t *aoff, *boff;
+    size_t m, n, nw;
+    size_t lcs;
+    uint64_t *col;
+    size_t i, j, k;
+
+    cd->editc = 0;
+    m = decode(cd, 0, s1, len1);
+    n = decode(cd, 1, s2, len2);
+    if (m == 0 || n == 0 || m > FINE_MAX || n > FINE_MAX) {
+        return (0);
+    }
+    av = cd->chv[0];
+    bv = cd->chv[1];
+    aoff = cd->offv[0];
+    boff = cd->offv[1];
+
+    nw = (m + 63) / 64;
+    cd->symv = vec_reserve(cd->symv, &cd->symsz, m, sizeof (unsigned long));
+    build_masks(cd, m, nw);
+
+    /*
+     * Column j is the bit-vector after j characters of the reversed
+     * "after" text.  Bit i is 0 where the length of the LCS grows
+     * by one going down the column, at row i + 1, and 1 where it
+     * stays the same.  Column 0 is all ones.
+     */
+    cd->colv = vec_reserve(cd->colv, &cd->colsz, (n + 1) * nw, sizeof (uint64_t));
+    col = cd->colv;
+    for (k = 0; k < nw; ++k) {
+        col[k] = ~(uint64_t)0;
+    }
+    for (j = 0; j < n; ++j) {
+        const uint64_t *peq = lookup_mask(cd, bv[n - 1 - j], nw);
+        const uint64_t *v = col + j * nw;
+        uint64_t *nv = col + (j + 1) * nw;
+        uint64_t carry = 0;
+
+        for (k = 0; k < nw; ++k) {
+            uint64_t u = v[k] & peq[k];
+            uint64_t t = v[k] + carry;
+            uint64_t sum = t + u;
+
+            carry = (t < v[k]) | (sum < t);
+            nv[k] = sum | (v[k] - u);
+        }
+    }
+
+    lcs = 0;
+    col = cd->colv + n * nw;
+    for (i = 0; i < m; ++i) {
+        lcs += !((col[i / 64] >> (i % 64)) & 1);
+    }
+    if (2 * lcs < (m > n ? m : n)) {
+        return (0);
+    }
+
+    /*
+     * Trace back from the bottom right, which is the front of both
+     * texts.  Equal characters are always part of some LCS.
+     * Otherwise, go up, a deletion, if that keeps the same LCS,
+     * else left, an insertion.
+     */
+    i = m;
+    j = n;
+    while (i != 0 || j != 0) {
+        size_t x = m - i;
+        size_t y = n - j;
+
+        if (i != 0 && j != 0 && av[x] == bv[y]) {
+            push_edit(cd, ' ', s1 + aoff[x], aoff[x + 1] - aoff[x]);
+            --i;
+            --j;
+        }
+        else if (i != 0
+                 && ((cd->colv[j * nw + (i - 1) / 64] >> ((i - 1) % 64)) & 1)) {
+            push_edit(cd, '-', s1 + aoff[x], aoff[x + 1] - aoff[x]);
+            --i;
+        }
+        else {
+            push_edit(cd, '+', s2 + boff[y], boff[y + 1] - boff[y]);
+            --j;
+        }
+    }
+    return (cd->editc);
+}
@@ -0,0 +1,388 @@
+/*
+ * Filename: src/cmd/follow.c
+ * Project: wdiff-align
+ * Brief: Align lines as they are appended to a file, for --series --follow
+ *
+ * Description:
+ *   Like 'tail -f', but each new line is aligned with the line
+ *   before it, as with --series, and shown as soon as it is complete.
+ *
+ *   Lines already in the file are not shown;  only the last of them
+ *   is kept, to be compared with the first new line.
+ *
+ *   The file is watched with inotify, so there is no polling:
+ *   the process sleeps in read() until the file changes.
+ *   Its directory is watched as well, so that when the file is
+ *   rotated -- renamed or removed, and a new one created in its
+ *   place -- the rest of the old file is read, and the new file
+ *   is followed from its start.  If the file is truncated, as by
+ *   'logrotate copytruncate', it is followed from its start again.
+ *
+ *   The last line is kept through truncation and rotation,
+ *   so that the series goes on unbroken.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+    // Import pread()
+
+#include <errno.h>
+    // Import var errno
+    // Import constant EINTR
+#include <fcntl.h>
+    // Import open()
+    // Import constant O_RDONLY
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdio.h>
+    // Import type FILE
+    // Import fflush()
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memchr()
+    // Import memcpy()
+    // Import strcmp()
+    // Import strdup()
+    // Import strrchr()
+#include <sys/inotify.h>
+    // Import inotify_add_watch()
+    // Import inotify_init1()
+    // Import inotify_rm_watch()
+    // Import type struct inotify_event
+#include <sys/stat.h>
+    // Import fstat()
+    // Import stat()
+    // Import type struct stat
+#include <unistd.h>
+    // Import close()
+    // Import pread()
+    // Import read()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+#define READ_SIZE (64 * 1024)
+
+/*
+ * State of following one file.  |off| is how much of the current
+ * file has been read;  |pend| holds a last line that is not yet
+ * complete.  |seeding| is true while the lines that were already
+ * in the file are read, only to keep the last one.
+ */
+struct follow {
+    series_t   *s;
+    const char *fname;
+    const char *base;
+    int        fd;
+    off_t      off;
+    int        ifd;
+    int        wfile;
+    int        wdir;
+    bool       seeding;
+    char       *buf;
+    char       *pend;
+    size_t     plen;
+    size_t     psz;
+};
+
+typedef struct follow follow_t;
+
+/*
+ * Take one whole line, without its terminator.
+ */
+static void
+follow_line(follow_t *fw, const char *line, size_t len)
+{
+    if (len != 0 && line[len - 1] == '\r') {
+        --len;
+    }
+    if (fw->seeding) {
+        series_seed(fw->s, line, len);
+    }
+    else {
+        series_line(fw->s, line, len);
+    }
+}
+
+/*
+ * Take some bytes read from the file:  each whole line,
+ * and any partial line at the end, to be completed later.
+ */
+static void
+follow_bytes(follow_t *fw, const char *p, size_t n)
+{
+    const char *end = p + n;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t len = (nl ? nl : end) - p;
+
+        if (fw->plen + len > fw->psz) {
+            fw->psz = 2 * (fw->plen + len);
+            fw->pend = guard_realloc(fw->pend, fw->psz);
+        }
+        if (nl == NULL) {
+            memcpy(fw->pend + fw->plen, p, len);
+            fw->plen += len;
+            return;
+        }
+        if (fw->plen != 0) {
+            memcpy(fw->pend + fw->plen, p, len);
+            follow_line(fw, fw->pend, fw->plen + len);
+            fw->plen = 0;
+        }
+        else {
+            follow_line(fw, p, len);
+        }
+        p = nl + 1;
+    }
+}
+
+/*
+ * Read everything new in the current file, and show the aligned lines
+ * at once.  If the file is now shorter than what has been read,
+ * it was truncated;  start over at its beginning, and drop any
+ * partial line, which is gone.
+ */
+static int
+follow_read(follow_t *fw)
+{
+    struct stat st;
+    ssize_t n;
+
+    if (fw->fd < 0) {
+        return (0);
+    }
+    if (fstat(fw->fd, &st) == 0 && st.st_size < fw->off) {
+        fw->off = 0;
+        fw->plen = 0;
+    }
+
+    while ((n = pread(fw->fd, fw->buf, READ_SIZE, fw->off)) > 0) {
+        follow_bytes(fw, fw->buf, n);
+        fw->off += n;
+    }
+    if (n < 0 && errno != EINTR) {
+        return (errno);
+    }
+
+    align_flush(&fw->s->align);
+    if (fw->s->align.dstf != NULL) {
+        fflush(fw->s->align.dstf);
+    }
+    return (0);
+}
+
+/*
+ * Open the file by name, and watch it.  It is not an error
+ * if it does not exist;  it will be opened when it is created.
+ */
+static int
+follow_open(follow_t *fw)
+{
+    fw->fd = open(fw->fname, O_RDONLY);
+    if (fw->fd < 0) {
+        return (errno == ENOENT ? 0 : errno);
+    }
+    fw->off = 0;
+    fw->wfile = inotify_add_watch(fw->ifd, fw->fname,
+        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    if (fw->wfile < 0) {
+        return (errno);
+    }
+    return (0);
+}
+
+/*
+ * The file may have been rotated.  Read what is left of the old one,
+ * which may have been written to after it was renamed,
+ * and move on to the new one, once there is one.
+ * The file by that name may be the one already open,
+ * if it was renamed and created again before we got here.
+ */
+static int
+follow_rotate(follow_t *fw)
+{
+    struct stat cur;
+    struct stat st;
+    int err;
+
+    err = follow_read(fw);
+    if (err) {
+        return (err);
+    }
+    if (stat(fw->fname, &st) != 0) {
+        // Keep reading the old file, until there is a new one.
+        return (0);
+    }
+    if (fw->fd >= 0 && fstat(fw->fd, &cur) == 0
+        && cur.st_dev == st.st_dev && cur.st_ino == st.st_ino) {
+        return (0);
+    }
+    if (fw->fd >= 0) {
+        inotify_rm_watch(fw->ifd, fw->wfile);
+        close(fw->fd);
+        fw->fd = -1;
+        fw->wfile = -1;
+    }
+    // A partial last line of the old file is complete.
+    if (fw->plen != 0) {
+        follow_line(fw, fw->pend, fw->plen);
+        fw->plen = 0;
+    }
+    err = follow_open(fw);
+    if (err) {
+        return (err);
+    }
+    return (follow_read(fw));
+}
+
+/*
+ * Handle one batch of inotify events.
+ */
+static int
+follow_events(follow_t *fw, const char *ev, size_t n)
+{
+    bool modified = false;
+    bool rotated = false;
+    size_t pos = 0;
+
+    while (pos < n) {
+        const struct inotify_event *e = (const struct inotify_event *)(ev + pos);
+
+        if (e->wd == fw->wfile && e->wd >= 0) {
+            if (e->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) {
+                rotated = true;
+            }
+            else {
+                modified = true;
+            }
+        }
+        else if (e->wd == fw->wdir && e->len != 0 && strcmp(e->name, fw->base) == 0) {
+            // A new file by the same name
+            rotated = true;
+        }
+        pos += sizeof (struct inotify_event) + e->len;
+    }
+
+    if (rotated) {
+        return (follow_rotate(fw));
+    }
+    if (modified) {
+        return (follow_read(fw));
+    }
+    return (0);
+}
+
+/**
+ * @brief Follow a file as lines are appended to it, and align
+ *        each new line with the line before it, as soon as it is complete.
+ * @param s      IN/OUT  State of the series.
+ * @param fname  IN      The file to follow.
+ * @return Only on error, the errno value.
+ *
+ * This runs until the process is killed.
+ */
+int
+series_follow(series_t *s, const char *fname)
+{
+    follow_t fw;
+    char *dir;
+    char *slash;
+    char evbuf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int err;
+
+    fw.s = s;
+    fw.fname = fname;
+    fw.fd = -1;
+    fw.off = 0;
+    fw.wfile = -1;
+    fw.seeding = true;
+    fw.buf = guard_malloc(READ_SIZE);
+    fw.pend = NULL;
+    fw.plen = 0;
+    fw.psz = 0;
+
+    dir = strdup(fname);
+    slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        fw.base = fname;
+        free(dir);
+        dir = strdup(".");
+    }
+    else {
+        fw.base = fname + (slash - dir) + 1;
+        slash[slash == dir ? 1 : 0] = '\0';
+    }
+
+    fw.ifd = inotify_init1(IN_CLOEXEC);
+    if (fw.ifd < 0) {
+        err = errno;
+        goto done;
+    }
+    fw.wdir = inotify_add_watch(fw.ifd, dir, IN_CREATE | IN_MOVED_TO);
+    if (fw.wdir < 0) {
+        err = errno;
+        goto done;
+    }
+
+    /*
+     * Keep only the last whole line already in the file;
+     * it is the line the first new line is compared with.
+     * A partial line after it is completed by the first write.
+     */
+    err = follow_open(&fw);
+    if (err == 0) {
+        err = follow_read(&fw);
+    }
+    if (err) {
+        goto done;
+    }
+    fw.seeding = false;
+
+    while (true) {
+        ssize_t n = read(fw.ifd, evbuf, sizeof (evbuf));
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = n < 0 ? errno : EIO;
+            break;
+        }
+        err = follow_events(&fw, evbuf, n);
+        if (err) {
+            break;
+        }
+    }
+
+done:
+    if (fw.fd >= 0) {
+        close(fw.fd);
+    }
+    if (fw.ifd >= 0) {
+        close(fw.ifd);
+    }
+    free(dir);
+    free(fw.buf);
+    free(fw.pend);
+    return (err);
+}
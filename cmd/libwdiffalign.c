@@ -0,0 +1,348 @@
+/*
+ * Filename: src/cmd/libwdiffalign.c
+ * Project: wdiff-align
+ * Brief: Reentrant library interface to the aligner
+ *
+ * Description:
+ *   A context bundles everything that the wdiff-align command keeps
+ *   for one stream:  the compiled markers, a push scanner, and the
+ *   renderer;  plus working storage for the native word diff.
+ *   Nothing is shared between contexts, and nothing is written
+ *   to stdout or stderr;  output and warnings go to callbacks.
+ *
+ *   The internals allocate with the guards of libcscript, which exit
+ *   when memory runs out.  Each entry point pushes a handler for
+ *   its thread, which instead jumps back out to the entry point,
+ *   so that it returns ENOMEM.  A context that has run out of memory
+ *   may be half way through a line, so from then on it only refuses
+ *   work, until it is freed.
+ *
+ *   See inc/wdiffalign.h for the interface.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+    // Import constant ENOMEM
+#include <setjmp.h>
+    // Import longjmp()
+    // Import setjmp()
+    // Import type jmp_buf
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+    // Import type size_t
+#include <stdio.h>
+    // Import type FILE
+#include <stdlib.h>
+    // Import calloc()
+    // Import free()
+#include <string.h>
+    // Import memset()
+
+#include <cscript.h>
+#include <wdiffalign.h>
+#include "wdiff-align.h"
+
+/*
+ * libcscript refers to errprint_fh, which a program normally defines.
+ * Nothing is written to it through the entry points of the library,
+ * which catch a failed allocation before it would be reported.
+ * It is not exported from the shared library;  see libwdiffalign.map.
+ */
+__attribute__((weak)) FILE *errprint_fh = NULL;
+
+struct wda {
+    marker_dfa_t dfa;
+    scan_t       scan;
+    align_t      align;
+    word_diff_t  wd;
+    jmp_buf      oom;
+    guard_oom_t  guard;
+    bool         failed;
+};
+
+/*
+ * An allocation failed, within an entry point.
+ */
+static void
+out_of_memory(void *arg)
+{
+    wda_t *ctx = arg;
+
+    ctx->failed = true;
+    longjmp(ctx->oom, 1);
+}
+
+/*
+ * Each entry point that can allocate does, first,
+ *
+ *     if (ctx->failed || setjmp(ctx->oom) != 0) {
+ *         return (ENOMEM);
+ *     }
+ *     guard_begin(ctx);
+ *
+ * and guard_end(ctx) before it returns.  setjmp() must be called
+ * in the entry point itself, so that the frame it jumps back to
+ * is still there.
+ */
+static void
+guard_begin(wda_t *ctx)
+{
+    ctx->guard.fn = out_of_memory;
+    ctx->guard.arg = ctx;
+    guard_push_oom(&ctx->guard);
+}
+
+static void
+guard_end(wda_t *ctx)
+{
+    guard_pop_oom(&ctx->guard);
+}
+
+/**
+ * @brief Fill in the default options:  standard markers, color,
+ *        and no middle line, as with wdiff-align with no options.
+ */
+void
+wda_options_default(wda_options_t *opt)
+{
+    memset(opt, 0, sizeof (*opt));
+    opt->color = true;
+}
+
+/*
+ * Fill in a new, zeroed context.
+ * Return false if memory ran out.
+ */
+static bool
+context_init(wda_t *ctx, const syntax_t *markers, const wda_options_t *opt)
+{
+    if (setjmp(ctx->oom) != 0) {
+        return (false);
+    }
+    guard_begin(ctx);
+    marker_dfa_compile(&ctx->dfa, markers, N_MARKERS);
+    scan_init_push(&ctx->scan, &ctx->dfa);
+    align_init(&ctx->align, NULL, opt->color, opt->show_midline);
+    ctx->align.fold = opt->fold;
+    ctx->align.fine = opt->fine;
+    word_diff_init(&ctx->wd);
+    guard_end(ctx);
+    return (true);
+}
+
+/**
+ * @brief Make a new context.
+ * @param opt    IN   Options, or NULL for the defaults.
+ * @param emsgp  OUT  If not NULL, and the markers are not usable,
+ *                    or memory ran out, a description of the problem.
+ * @return The new context, or NULL if the markers are not usable,
+ *         or memory ran out.
+ *
+ * Output is thrown away until a sink is set.
+ */
+wda_t *
+wda_new(const wda_options_t *opt, const char **emsgp)
+{
+    wda_options_t dflt;
+    syntax_t markers[N_MARKERS];
+    const char *emsg;
+    wda_t *ctx;
+    size_t i;
+
+    if (opt == NULL) {
+        wda_options_default(&dflt);
+        opt = &dflt;
+    }
+
+    syntax_default(markers, opt->ctrl);
+    for (i = 0; i < N_MARKERS; ++i) {
+        if (opt->markers[i] != NULL) {
+            markers[i].str = opt->markers[i];
+        }
+    }
+    emsg = syntax_check(markers, N_MARKERS);
+    if (emsg == NULL) {
+        ctx = calloc(1, sizeof (*ctx));
+        if (ctx == NULL) {
+            emsg = "out of memory";
+        }
+    }
+    if (emsgp != NULL) {
+        *emsgp = emsg;
+    }
+    if (emsg != NULL) {
+        return (NULL);
+    }
+
+    if (!context_init(ctx, markers, opt)) {
+        // Everything was zeroed, so a context that is only partly
+        // made can be freed.
+        wda_free(ctx);
+        if (emsgp != NULL) {
+            *emsgp = "out of memory";
+        }
+        return (NULL);
+    }
+    return (ctx);
+}
+
+void
+wda_free(wda_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    word_diff_free(&ctx->wd);
+    align_free(&ctx->align);
+    scan_free(&ctx->scan);
+    marker_dfa_free(&ctx->dfa);
+    free(ctx);
+}
+
+/*
+ * With no sink, output would pile up in the output buffer.
+ */
+static void
+discard(void *arg, const char *buf, size_t len)
+{
+    (void)arg;
+    (void)buf;
+    (void)len;
+}
+
+void
+wda_set_sink(wda_t *ctx, wda_sink_fn sink, void *arg)
+{
+    ctx->align.sink = sink ? sink : discard;
+    ctx->align.sink_arg = arg;
+}
+
+/**
+ * @brief Set the function to be called with warnings.
+ *
+ * With no warning function, warnings are dropped.
+ */
+void
+wda_set_warn(wda_t *ctx, wda_warn_fn warn, void *arg)
+{
+    ctx->align.warn = warn;
+    ctx->align.warn_arg = arg;
+}
+
+static void
+drop_warning(void *arg, const char *msg)
+{
+    (void)arg;
+    (void)msg;
+}
+
+static void
+ensure_callbacks(wda_t *ctx)
+{
+    if (ctx->align.sink == NULL) {
+        ctx->align.sink = discard;
+    }
+    if (ctx->align.warn == NULL) {
+        ctx->align.warn = drop_warning;
+    }
+}
+
+/**
+ * @brief Push a piece of wdiff output to be aligned.
+ * @param ctx  IN/OUT  The context.
+ * @param buf  IN      The next piece of input.
+ * @param len  IN      Its length.
+ * @return 0, or ENOMEM if memory ran out, now or before.
+ *
+ * Aligned lines go to the sink in batches, as they are completed.
+ */
+int
+wda_push(wda_t *ctx, const void *buf, size_t len)
+{
+    if (ctx->failed || setjmp(ctx->oom) != 0) {
+        return (ENOMEM);
+    }
+    guard_begin(ctx);
+    ensure_callbacks(ctx);
+    scan_push(&ctx->scan, buf, len);
+    align_spans(&ctx->align, &ctx->scan);
+    guard_end(ctx);
+    return (0);
+}
+
+/**
+ * @brief End the input.
+ * @return 0, or ENOMEM if memory ran out, now or before.
+ *
+ * Any incomplete marker held back is plain text, a last line with
+ * no line terminator is aligned, and all output goes to the sink.
+ * The context is then ready for a new, unrelated stream.
+ */
+int
+wda_finish(wda_t *ctx)
+{
+    if (ctx->failed || setjmp(ctx->oom) != 0) {
+        return (ENOMEM);
+    }
+    guard_begin(ctx);
+    ensure_callbacks(ctx);
+    scan_push_end(&ctx->scan);
+    align_spans(&ctx->align, &ctx->scan);
+    align_finish(&ctx->align);
+
+    ctx->scan.pos = 0;
+    ctx->scan.end = 0;
+    ctx->scan.eof = false;
+    ctx->align.in_insert = false;
+    ctx->align.in_delete = false;
+    guard_end(ctx);
+    return (0);
+}
+
+/**
+ * @brief Diff two texts natively, and align the result,
+ *        exactly as if the output of wdiff had been pushed.
+ * @param ctx   IN/OUT  The context.
+ * @param s1    IN      The "before" text.
+ * @param len1  IN      Length of |s1|.
+ * @param s2    IN      The "after" text.
+ * @param len2  IN      Length of |s2|.
+ * @return 0, or ENOMEM if memory ran out, now or before.
+ *
+ * All output goes to the sink before this returns.
+ */
+int
+wda_diff(wda_t *ctx, const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    if (ctx->failed || setjmp(ctx->oom) != 0) {
+        return (ENOMEM);
+    }
+    guard_begin(ctx);
+    ensure_callbacks(ctx);
+    word_diff(&ctx->wd, s1, len1, s2, len2);
+    align_edits(&ctx->align, ctx->wd.editv, ctx->wd.editc);
+    align_finish(&ctx->align);
+    ctx->align.in_insert = false;
+    ctx->align.in_delete = false;
+    guard_end(ctx);
+    return (0);
+}
@@ -22,6 +22,9 @@
 
 #include <ctype.h>
     // Import isprint()
+#include <errno.h>
+    // Import var errno
+    // Import constant EWOULDBLOCK
 #include <stdbool.h>
     // Import type bool
     // Import constant false
@@ -42,18 +45,21 @@
     // Import var stdout
 #include <stdlib.h>
     // Import exit()
+    // Import free()
 #include <string.h>
     // Import strcmp()
     // Import strncmp()
 #include <unistd.h>
     // Import getopt_long()
+    // Import isatty()
+    // Import sysconf()
+    // Import constant STDOUT_FILENO
     // Import type size_t
 #include <getopt.h>
     // Import getopt_long()
 
 #include <cscript.h>
-
-extern char wdiff_align(FILE *srcf, FILE *dstf, bool ctrl, bool color, bool mid);
+#include "wdiff-align.h"
 
 const char *program_path;
 const char *program_name;
@@ -66,6 +72,43 @@ bool debug   = false;
 
 static bool ctrl         = false;
 static bool show_midline = false;
+static bool native_diff  = false;
+static bool series       = false;
+static bool ltrim        = false;
+static bool rtrim        = false;
+static size_t elide_min  = ELIDE_MIN;
+static int diff_algorithm = diff_myers;
+static const char *cache_path = NULL;
+static size_t cache_max = CACHE_MAX;
+static bool cache_stats = false;
+static bool follow       = false;
+static bool nearest      = false;
+static size_t nearest_min = NEAREST_MIN;
+static size_t nearest_max = NEAREST_MAX;
+static bool color        = false;
+
+// When to color:  --color=auto|always|never
+
+#define color_auto   0
+#define color_always 1
+#define color_never  2
+
+static int color_when = color_auto;
+
+static const char *marker_opt[N_MARKERS];
+static int simd_level = simd_auto;
+static size_t fold = 0;
+static bool fine = false;
+static int format = format_text;
+static bool columns = false;
+static size_t njobs = 1;
+static bool njobs_given = false;
+static const char *serve_path = NULL;
+
+static bool show_stats = false;
+static const char *stats_json = NULL;
+static stats_t run_stats;
+static stats_t *stats = NULL;
 
 static struct option long_options[] = {
     {"help",           no_argument,       0,  'h'},
@@ -74,6 +117,34 @@ static struct option long_options[] = {
     {"debug",          no_argument,       0,  'd'},
     {"ctrl",           no_argument,       0,  'c'},
     {"midline",        no_argument,       0,  'm'},
+    {"color",          required_argument, 0,  'C'},
+    {"diff",           no_argument,       0,  'D'},
+    {"series",         no_argument,       0,  's'},
+    {"ltrim",          no_argument,       0,  'L'},
+    {"rtrim",          no_argument,       0,  'R'},
+    {"trim",           no_argument,       0,  'T'},
+    {"elide-min",      required_argument, 0,  'E'},
+    {"diff-algorithm", required_argument, 0,  'A'},
+    {"cache",          required_argument, 0,  'k'},
+    {"cache-max",      required_argument, 0,  'K'},
+    {"cache-stats",    no_argument,       0,  'P'},
+    {"follow",         no_argument,       0,  'o'},
+    {"nearest",        no_argument,       0,  'N'},
+    {"nearest-min",    required_argument, 0,  'G'},
+    {"nearest-max",    required_argument, 0,  'M'},
+    {"start-insert",   required_argument, 0,  'i'},
+    {"end-insert",     required_argument, 0,  'I'},
+    {"start-delete",   required_argument, 0,  'w'},
+    {"end-delete",     required_argument, 0,  'W'},
+    {"simd",           required_argument, 0,  'X'},
+    {"fold",           required_argument, 0,  'F'},
+    {"fine",           no_argument,       0,  'f'},
+    {"format",         required_argument, 0,  'O'},
+    {"columns",        no_argument,       0,  'U'},
+    {"jobs",           required_argument, 0,  'j'},
+    {"serve",          required_argument, 0,  'Y'},
+    {"stats",          no_argument,       0,  'S'},
+    {"stats-json",     required_argument, 0,  'J'},
     {0, 0, 0, 0}
 };
 
@@ -86,6 +157,53 @@ static const char usage_text[] =
     "                       for start/end insert/delete markers\n"
     "  --debug|-d           debug\n"
     "  --midline|-m         Show line of +/- in the middle\n"
+    "  --color=WHEN         Color deletions red and insertions green:\n"
+    "                       auto (if stdout is a terminal), always, never\n"
+    "  --diff|-D OLD NEW    Compute the word diff of two files natively,\n"
+    "                       instead of reading the output of wdiff\n"
+    "  --series|-s [FILE...]\n"
+    "                       Align each line with the line before it\n"
+    "  --ltrim              With --series, elide a long common prefix\n"
+    "  --rtrim              With --series, elide a long common suffix\n"
+    "  --trim               Same as --ltrim --rtrim\n"
+    "  --elide-min=N        Elide a common prefix or suffix only if it is\n"
+    "                       longer than N bytes;  the default is 10\n"
+    "  --diff-algorithm=ALG With --diff or --series, diff words using\n"
+    "                       myers (the default) or histogram\n"
+    "  --cache=FILE         With --series, keep the output of each pair\n"
+    "                       of lines in FILE, and reuse it on later runs\n"
+    "  --cache-max=BYTES    Cap the cache file at BYTES;  the least\n"
+    "                       recently used pairs go first.  Default 64 MiB\n"
+    "  --cache-stats        At exit, show the cache hit rate on stderr\n"
+    "  --follow             With --series and one FILE, like 'tail -f':\n"
+    "                       align each line as it is appended to FILE\n"
+    "  --nearest            With --series, align each line with the most\n"
+    "                       similar earlier line, not the line before it\n"
+    "  --nearest-min=PCT    Only if at least PCT% similar;  default 50\n"
+    "  --nearest-max=BYTES  Cap the memory to find similar lines at BYTES;\n"
+    "                       the oldest lines go first.  Default 128 MiB\n"
+    "  --start-insert=STR   Markers used by wdiff, if not the default,\n"
+    "  --end-insert=STR       as with the wdiff options of the same name.\n"
+    "  --start-delete=STR     Markers can be any length.\n"
+    "  --end-delete=STR\n"
+    "  --fold=WIDTH         Show long lines in bands of WIDTH columns,\n"
+    "                       each as soon as it is full\n"
+    "  --fine               Show which characters changed, within\n"
+    "                       a deleted word next to an inserted word\n"
+    "  --format=FMT         Write aligned lines (text, the default), or\n"
+    "                       a record of the runs of each line, as JSON\n"
+    "                       lines (jsonl), or in binary (edits)\n"
+    "  --columns            With --format=jsonl or edits, give each run\n"
+    "                       its column and width in the aligned lines\n"
+    "  --simd=LEVEL         Skip plain text using auto|avx2|sse2|scalar\n"
+    "  --jobs|-j N          Align up to N input files, or chunks of\n"
+    "                       a large file, at once;  output stays in order.\n"
+    "                       Not for --diff or --series\n"
+    "  --serve SOCKET       Serve requests on a Unix socket, until killed,\n"
+    "                       with N worker threads (-j N), or one per CPU\n"
+    "  --stats              At exit, show bytes, records, markers, line width,\n"
+    "                       warnings, and time spent, on stderr\n"
+    "  --stats-json=FILE    Same, but write them to FILE as JSON\n"
     "\n"
     ;
 
@@ -125,7 +243,10 @@ show_program_version(void)
 static void
 usage(void)
 {
-    eprintf("usage: %s [ <options> ]\n", program_name);
+    eprintf("usage: %s [ <options> ] [FILE...]\n", program_name);
+    eprintf("       %s [ <options> ] --diff OLD NEW\n", program_name);
+    eprintf("       %s [ <options> ] --series [FILE...]\n", program_name);
+    eprintf("       %s [ -j N ] --serve SOCKET\n", program_name);
     eprintf("%s", usage_text);
 }
 
@@ -135,6 +256,306 @@ is_long_option(const char *s)
     return (s[0] == '-' && s[1] == '-');
 }
 
+/*
+ * Read the entire contents of the file, |fname|, into memory.
+ * Return NULL, after reporting the error, if it cannot be read.
+ */
+static char *
+slurp_file(const char *fname, size_t *lenp)
+{
+    FILE *f;
+    char *buf;
+    size_t sz;
+    size_t len;
+    size_t n;
+
+    f = fopen(fname, "r");
+    if (f == NULL) {
+        int err = errno;
+        eprintf("%s: fopen('%s') failed.\n", program_name, fname);
+        eexplain_err(err);
+        return (NULL);
+    }
+
+    sz = 8192;
+    len = 0;
+    buf = guard_malloc(sz);
+    while ((n = fread(buf + len, 1, sz - len, f)) != 0) {
+        len += n;
+        if (len == sz) {
+            sz *= 2;
+            buf = guard_realloc(buf, sz);
+        }
+    }
+
+    if (ferror(f)) {
+        int err = errno;
+        eprintf("%s: read of '%s' failed.\n", program_name, fname);
+        eexplain_err(err);
+        fclose(f);
+        free(buf);
+        return (NULL);
+    }
+
+    fclose(f);
+    *lenp = len;
+    return (buf);
+}
+
+/*
+ * Diff two files natively, and show the aligned result,
+ * exactly as if the output of wdiff had been fed to wdiff_align().
+ */
+static int
+diff_align_files(const char *fname1, const char *fname2, FILE *dstf)
+{
+    word_diff_t wd;
+    align_t align;
+    char *text1;
+    char *text2;
+    size_t len1;
+    size_t len2;
+
+    double t0 = 0;
+    double prev = 0;
+
+    if (stats != NULL) {
+        t0 = stats_clock();
+    }
+    text1 = slurp_file(fname1, &len1);
+    if (text1 == NULL) {
+        return (2);
+    }
+    text2 = slurp_file(fname2, &len2);
+    if (text2 == NULL) {
+        free(text1);
+        return (2);
+    }
+    if (stats != NULL) {
+        stats->t_io += stats_clock() - t0;
+        stats->bytes_read += len1 + len2;
+        t0 = stats_clock();
+        prev = stats->t_render + stats->t_io;
+    }
+
+    word_diff_init(&wd);
+    wd.algorithm = diff_algorithm;
+    word_diff(&wd, text1, len1, text2, len2);
+    align_init(&align, dstf, color, show_midline);
+    align.fold = fold;
+    align.fine = fine;
+    align.format = format;
+    align.columns = columns;
+    align.stats = stats;
+    align_edits(&align, wd.editv, wd.editc);
+    align_finish(&align);
+    if (stats != NULL) {
+        stats_add_parse(stats, t0, prev);
+    }
+
+    align_free(&align);
+    word_diff_free(&wd);
+    free(text1);
+    free(text2);
+    return (0);
+}
+
+/*
+ * Treat the lines of all the given files, or of stdin,
+ * as one series of incremental changes.
+ */
+static int
+series_align_files(int filec, char **filev, FILE *dstf)
+{
+    series_t ser;
+    cache_t cache;
+    nearest_t near;
+    int rv;
+    int i;
+
+    series_init(&ser, dstf, ltrim, rtrim, color);
+    ser.wd.elide_min = elide_min;
+    ser.wd.algorithm = diff_algorithm;
+    ser.align.fold = fold;
+    ser.align.fine = fine;
+    ser.align.format = format;
+    ser.align.columns = columns;
+    ser.align.stats = stats;
+    rv = 0;
+
+    if (nearest) {
+        nearest_init(&near, nearest_max, nearest_min);
+        ser.near = &near;
+    }
+
+    if (cache_path != NULL) {
+        int err = cache_open(&cache, cache_path, cache_max);
+        if (err == EWOULDBLOCK) {
+            eprintf("%s: cache '%s' is in use by another run;"
+                " going without it.\n", program_name, cache_path);
+        }
+        else if (err) {
+            // Not fatal;  just diff every pair.
+            eprintf("%s: cannot open cache '%s'.\n", program_name, cache_path);
+            eexplain_err(err);
+        }
+        else {
+            ser.cache = &cache;
+        }
+    }
+
+    if (follow) {
+        int err = series_follow(&ser, filev[0]);
+        if (err) {
+            eprintf("%s: cannot follow '%s'.\n", program_name, filev[0]);
+            eexplain_err(err);
+            rv = 2;
+        }
+        filec = 0;
+    }
+    else if (filec == 0) {
+        int err = series_align(&ser, stdin);
+        if (err) {
+            eprintf("%s: read of stdin failed.\n", program_name);
+            eexplain_err(err);
+            rv = 2;
+        }
+    }
+
+    for (i = 0; i < filec; ++i) {
+        FILE *f;
+        int err;
+
+        f = fopen(filev[i], "r");
+        if (f == NULL) {
+            err = errno;
+            eprintf("%s: fopen('%s') failed.\n", program_name, filev[i]);
+            eexplain_err(err);
+            rv = 2;
+            continue;
+        }
+        err = series_align(&ser, f);
+        if (err) {
+            eprintf("%s: read of '%s' failed.\n", program_name, filev[i]);
+            eexplain_err(err);
+            rv = 2;
+        }
+        fclose(f);
+    }
+
+    series_free(&ser);
+    if (ser.near != NULL) {
+        nearest_free(&near);
+    }
+    if (ser.cache != NULL) {
+        fflush(dstf);
+        cache_close(&cache);
+        if (cache_stats) {
+            cache_print_stats(errprint_fh, &cache);
+        }
+    }
+    return (rv);
+}
+
+/*
+ * Align the output of wdiff, read from each of the given files,
+ * or from stdin.  Each file starts out neither inserting nor deleting.
+ * Regular files, including stdin if it is redirected from one,
+ * are memory-mapped.
+ */
+static int
+wdiff_align_files(int filec, char **filev, FILE *dstf)
+{
+    syntax_t markers[N_MARKERS];
+    marker_dfa_t dfa;
+    const char *emsg;
+    int level;
+    int rv;
+    int i;
+
+    syntax_default(markers, ctrl);
+    for (i = 0; i < N_MARKERS; ++i) {
+        if (marker_opt[i] != NULL) {
+            markers[i].str = marker_opt[i];
+        }
+    }
+    emsg = syntax_check(markers, N_MARKERS);
+    if (emsg != NULL) {
+        eprintf("%s: Invalid markers: %s.\n", program_name, emsg);
+        return (1);
+    }
+
+    marker_dfa_compile(&dfa, markers, N_MARKERS);
+    level = skip_select(&dfa, simd_level);
+    if (verbose) {
+        eprintf("%s: skip plain text using %s\n",
+            program_name, simd_level_name(level));
+    }
+
+    if (filec == 0) {
+        static char *stdin_filev[] = { "-" };
+
+        filec = 1;
+        filev = stdin_filev;
+    }
+
+    if (njobs > 1) {
+        rv = wdiff_align_parallel(filec, filev, dstf, &dfa,
+                                  color, show_midline, fold, fine, format, columns,
+                                  njobs, stats);
+        marker_dfa_free(&dfa);
+        return (rv);
+    }
+
+    rv = 0;
+    for (i = 0; i < filec; ++i) {
+        int err = wdiff_align_file(filev[i], dstf, &dfa, color, show_midline, fold, fine,
+                                   format, columns, stats);
+        if (err) {
+            fflush(dstf);
+            eprintf("%s: cannot read '%s'.\n", program_name, filev[i]);
+            eexplain_err(err);
+            rv = 2;
+        }
+    }
+
+    marker_dfa_free(&dfa);
+    return (rv);
+}
+
+/*
+ * Report the statistics of the run, as asked for by --stats
+ * and --stats-json.
+ */
+static int
+report_stats(double t_wall)
+{
+    FILE *f;
+
+    if (show_stats) {
+        stats_print(errprint_fh, stats, t_wall);
+    }
+    if (stats_json == NULL) {
+        return (0);
+    }
+
+    f = fopen(stats_json, "w");
+    if (f == NULL) {
+        int err = errno;
+        eprintf("%s: fopen('%s') failed.\n", program_name, stats_json);
+        eexplain_err(err);
+        return (2);
+    }
+    stats_print_json(f, stats, t_wall);
+    if (fclose(f) != 0) {
+        int err = errno;
+        eprintf("%s: write of '%s' failed.\n", program_name, stats_json);
+        eexplain_err(err);
+        return (2);
+    }
+    return (0);
+}
+
 static inline char *
 vischar_r(char *buf, size_t sz, int c)
 {
@@ -157,8 +578,7 @@ main(int argc, char **argv)
     int err_count;
     int optc;
     int rv;
-
-    (void)optarg;       // So far, no options take arguments.
+    double t_start;
 
     set_eprint_fh();
     program_path = *argv;
@@ -176,7 +596,7 @@ main(int argc, char **argv)
         }
 
         this_option_optind = optind ? optind : 1;
-        optc = getopt_long(argc, argv, "+hVdvcm", long_options, &option_index);
+        optc = getopt_long(argc, argv, "+hVdvcmDsj:", long_options, &option_index);
         if (optc == -1) {
             break;
         }
@@ -207,6 +627,160 @@ main(int argc, char **argv)
         case 'm':
             show_midline = true;
             break;
+        case 'C':
+            if (strcmp(optarg, "auto") == 0) {
+                color_when = color_auto;
+            }
+            else if (strcmp(optarg, "always") == 0) {
+                color_when = color_always;
+            }
+            else if (strcmp(optarg, "never") == 0) {
+                color_when = color_never;
+            }
+            else {
+                eprintf("%s: invalid --color, '%s';"
+                    " must be auto, always or never\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'D':
+            native_diff = true;
+            break;
+        case 's':
+            series = true;
+            break;
+        case 'o':
+            follow = true;
+            break;
+        case 'N':
+            nearest = true;
+            break;
+        case 'G':
+            if (parse_cardinal(&nearest_min, optarg) != 0 || nearest_min > 100) {
+                eprintf("%s: invalid --nearest-min, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'M':
+            if (parse_cardinal(&nearest_max, optarg) != 0) {
+                eprintf("%s: invalid --nearest-max, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'L':
+            ltrim = true;
+            break;
+        case 'R':
+            rtrim = true;
+            break;
+        case 'T':
+            ltrim = true;
+            rtrim = true;
+            break;
+        case 'E':
+            if (parse_cardinal(&elide_min, optarg) != 0) {
+                eprintf("%s: invalid --elide-min, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'A':
+            if (strcmp(optarg, "myers") == 0) {
+                diff_algorithm = diff_myers;
+            }
+            else if (strcmp(optarg, "histogram") == 0) {
+                diff_algorithm = diff_histogram;
+            }
+            else {
+                eprintf("%s: invalid --diff-algorithm, '%s';"
+                    " must be myers or histogram\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'k':
+            cache_path = optarg;
+            break;
+        case 'K':
+            if (parse_cardinal(&cache_max, optarg) != 0) {
+                eprintf("%s: invalid --cache-max, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'P':
+            cache_stats = true;
+            break;
+        case 'i':
+            marker_opt[0] = optarg;
+            break;
+        case 'I':
+            marker_opt[1] = optarg;
+            break;
+        case 'w':
+            marker_opt[2] = optarg;
+            break;
+        case 'W':
+            marker_opt[3] = optarg;
+            break;
+        case 'F':
+            if (parse_cardinal(&fold, optarg) != 0 || fold == 0) {
+                eprintf("%s: invalid fold width, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'f':
+            fine = true;
+            break;
+        case 'O':
+            if (strcmp(optarg, "text") == 0) {
+                format = format_text;
+            }
+            else if (strcmp(optarg, "jsonl") == 0) {
+                format = format_jsonl;
+            }
+            else if (strcmp(optarg, "edits") == 0) {
+                format = format_edits;
+            }
+            else {
+                eprintf("%s: invalid --format, '%s';"
+                    " must be text, jsonl or edits\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'U':
+            columns = true;
+            break;
+        case 'j':
+            if (parse_cardinal(&njobs, optarg) != 0 || njobs == 0) {
+                eprintf("%s: invalid number of jobs, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            njobs_given = true;
+            break;
+        case 'Y':
+            serve_path = optarg;
+            break;
+        case 'S':
+            show_stats = true;
+            break;
+        case 'J':
+            stats_json = optarg;
+            break;
+        case 'X':
+            simd_level = simd_level_by_name(optarg);
+            if (simd_level < 0) {
+                eprintf("%s: unknown SIMD level, '%s'\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
         case '?':
             eprint(program_name);
             eprint(": ");
@@ -231,14 +805,71 @@ main(int argc, char **argv)
 
     verbose = verbose || debug;
 
-    if (verbose && optind < argc) {
-        eprint("non-option ARGV-elements:\n");
-        while (optind < argc) {
-            eprint("    ");
-            eprint(argv[optind]);
-            eprint("\n");
-            ++optind;
-        }
+    color = color_when == color_always
+        || (color_when == color_auto && isatty(STDOUT_FILENO));
+
+    if (native_diff && series) {
+        eprintf("%s: --diff and --series are mutually exclusive.\n",
+            program_name);
+        ++err_count;
+    }
+
+    if (native_diff && argc - optind != 2) {
+        eprintf("%s: --diff requires exactly two files, OLD and NEW.\n",
+            program_name);
+        ++err_count;
+    }
+
+    // Each pair of a series, and a native diff, is aligned in turn.
+    if (njobs_given && (native_diff || series)) {
+        eprintf("%s: -j is not for --diff or --series.\n", program_name);
+        ++err_count;
+    }
+
+    if (cache_path != NULL && !series) {
+        eprintf("%s: --cache is only for --series.\n", program_name);
+        ++err_count;
+    }
+
+    if (follow && (!series || argc - optind != 1)) {
+        eprintf("%s: --follow requires --series and exactly one FILE.\n",
+            program_name);
+        ++err_count;
+    }
+
+    // A follow never ends, so the cache would never be unlocked,
+    // nor trimmed to --cache-max.
+    if (follow && cache_path != NULL) {
+        eprintf("%s: --follow and --cache are mutually exclusive.\n",
+            program_name);
+        ++err_count;
+    }
+
+    if (format != format_text && fold != 0) {
+        eprintf("%s: --fold is only for --format=text.\n", program_name);
+        ++err_count;
+    }
+
+    if (columns && format == format_text) {
+        eprintf("%s: --columns is only for --format=jsonl or edits.\n",
+            program_name);
+        ++err_count;
+    }
+
+    if (nearest && !series) {
+        eprintf("%s: --nearest is only for --series.\n", program_name);
+        ++err_count;
+    }
+
+    if (cache_stats && cache_path == NULL) {
+        eprintf("%s: --cache-stats needs --cache=FILE.\n", program_name);
+        ++err_count;
+    }
+
+    if (serve_path != NULL && (native_diff || series || argc != optind)) {
+        eprintf("%s: --serve takes no files, and no --diff or --series.\n",
+            program_name);
+        ++err_count;
     }
 
     if (err_count != 0) {
@@ -246,7 +877,39 @@ main(int argc, char **argv)
         exit(1);
     }
 
-    wdiff_align(stdin, stdout, ctrl, true, show_midline);
+    if (show_stats || stats_json != NULL) {
+        stats_init(&run_stats);
+        stats = &run_stats;
+    }
+    t_start = stats_clock();
+
+    if (serve_path != NULL) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (!njobs_given) {
+            njobs = ncpu > 0 ? ncpu : 1;
+        }
+        rv = wdiff_align_serve(serve_path, njobs);
+    }
+    else if (native_diff) {
+        rv = diff_align_files(argv[optind], argv[optind + 1], stdout);
+    }
+    else if (series) {
+        rv = series_align_files(argc - optind, argv + optind, stdout);
+    }
+    else {
+        rv = wdiff_align_files(argc - optind, argv + optind, stdout);
+    }
+
+    if (stats != NULL) {
+        int srv;
+
+        fflush(stdout);
+        srv = report_stats(stats_clock() - t_start);
+        if (rv == 0) {
+            rv = srv;
+        }
+    }
 
     if (rv != 0) {
         exit(rv);
@@ -0,0 +1,118 @@
+/*
+ * Filename: src/cmd/map-input.c
+ * Project: wdiff-align
+ * Brief: Open an input file, memory-mapped if possible
+ *
+ * Description:
+ *   A regular file is mapped into memory, and the scanner works
+ *   directly on the mapping, so there is no copy through a read
+ *   buffer, and the kernel can read ahead.  We advise the kernel
+ *   that access will be sequential, and that huge pages are welcome.
+ *
+ *   Anything else -- stdin, a pipe, a terminal, or a file that
+ *   cannot be mapped -- falls back to the block reader.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+    // Import madvise()
+    // Import constant MADV_HUGEPAGE
+
+#include <errno.h>
+    // Import var errno
+#include <fcntl.h>
+    // Import open()
+    // Import constant O_RDONLY
+#include <stddef.h>
+    // Import constant NULL
+#include <string.h>
+    // Import strcmp()
+#include <sys/mman.h>
+    // Import madvise()
+    // Import mmap()
+    // Import munmap()
+#include <sys/stat.h>
+    // Import fstat()
+    // Import type struct stat
+#include <unistd.h>
+    // Import close()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+/**
+ * @brief Open an input file, and map it into memory if it is regular.
+ * @param in     OUT  The input.
+ * @param fname  IN   File name, or "-" for stdin.
+ * @return 0 on success, else an errno value.
+ *
+ * If |in->map| is not NULL, the whole file is at |in->map|,
+ * and |in->maplen| bytes long.  Otherwise, read from |in->fd|.
+ */
+int
+input_open(input_t *in, const char *fname)
+{
+    struct stat st;
+    void *map;
+
+    in->fname = fname;
+    in->map = NULL;
+    in->maplen = 0;
+
+    if (strcmp(fname, "-") == 0) {
+        in->fd = 0;
+        in->fname = "stdin";
+    }
+    else {
+        in->fd = open(fname, O_RDONLY);
+        if (in->fd < 0) {
+            return (errno);
+        }
+    }
+
+    if (fstat(in->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return (0);
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+    if (map == MAP_FAILED) {
+        // Not fatal;  just read it instead.
+        return (0);
+    }
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+    in->map = map;
+    in->maplen = st.st_size;
+    return (0);
+}
+
+void
+input_close(input_t *in)
+{
+    if (in->map != NULL) {
+        munmap(in->map, in->maplen);
+        in->map = NULL;
+    }
+    if (in->fd > 0) {
+        close(in->fd);
+    }
+    in->fd = -1;
+}
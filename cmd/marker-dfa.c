@@ -0,0 +1,231 @@
+/*
+ * Filename: src/cmd/marker-dfa.c
+ * Project: wdiff-align
+ * Brief: Compile the table of insert/delete markers into a DFA
+ *
+ * Description:
+ *   The markers that wdiff uses for start/end of insert/delete
+ *   are fixed strings.  They are compiled, once, into a trie
+ *   with a full 256-way transition table at every state, so that
+ *   matching costs one table lookup per input byte, no matter how
+ *   many markers there are, or how long they are.
+ *
+ *   Markers that are a single byte, such as those used with --ctrl,
+ *   are also entered in a direct lookup table, so that they are
+ *   recognized without walking the trie at all.
+ *
+ *   Matching is anchored:  at a given position, the shortest marker
+ *   that is a prefix of the input wins.  If no marker matches,
+ *   the byte at that position is plain text.  This is the same
+ *   behavior as the original byte-at-a-time matcher.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+    // Import memset()
+    // Import strchr()
+    // Import strcmp()
+    // Import strlen()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+static const syntax_t syntax_tbl_std[] = {
+    { "{+", insert_start },
+    { "+}", insert_end   },
+    { "[-", delete_start },
+    { "-]", delete_end   },
+};
+
+static const syntax_t syntax_tbl_ctrl[] = {
+    { "\x1c", insert_start },
+    { "\x1d", insert_end   },
+    { "\x1e", delete_start },
+    { "\x1f", delete_end   },
+};
+
+/**
+ * @brief Fill in the default markers:
+ *        start insert, end insert, start delete, end delete.
+ * @param tbl   OUT  Array of N_MARKERS entries.
+ * @param ctrl  IN   Use control characters, as in wdiff-align --ctrl.
+ * @return void
+ */
+void
+syntax_default(syntax_t *tbl, bool ctrl)
+{
+    memcpy(tbl, ctrl ? syntax_tbl_ctrl : syntax_tbl_std,
+           N_MARKERS * sizeof (syntax_t));
+}
+
+/**
+ * @brief Check that a set of markers can be used by the scanner.
+ * @param tbl  IN  Array of markers.
+ * @param n    IN  Number of markers.
+ * @return NULL if OK, else a description of the problem.
+ */
+const char *
+syntax_check(const syntax_t *tbl, size_t n)
+{
+    size_t i, j;
+
+    for (i = 0; i < n; ++i) {
+        const char *s = tbl[i].str;
+
+        if (s[0] == '\0') {
+            return ("empty marker");
+        }
+        if (strchr(s, '\r') || strchr(s, '\n')) {
+            return ("marker contains a line terminator");
+        }
+        for (j = 0; j < i; ++j) {
+            if (strcmp(s, tbl[j].str) == 0) {
+                return ("duplicate marker");
+            }
+        }
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Compile a set of markers into a DFA.
+ * @param dfa  OUT  The compiled DFA.
+ * @param tbl  IN   Array of markers.
+ * @param n    IN   Number of markers.
+ * @return void
+ *
+ * The markers should already have passed syntax_check().
+ * The fastest available way to skip plain text is selected.
+ */
+void
+marker_dfa_compile(marker_dfa_t *dfa, const syntax_t *tbl, size_t n)
+{
+    size_t maxstates;
+    size_t i;
+
+    maxstates = 1;
+    for (i = 0; i < n; ++i) {
+        maxstates += strlen(tbl[i].str);
+    }
+
+    dfa->delta = guard_malloc(maxstates * 256 * sizeof (int));
+    dfa->accept = guard_calloc(maxstates, sizeof (int));
+    memset(dfa->delta, 0xff, 256 * sizeof (int));
+    dfa->nstates = 1;
+    dfa->maxlen = 0;
+    memset(dfa->direct, 0, sizeof (dfa->direct));
+    memset(dfa->special, 0, sizeof (dfa->special));
+    dfa->special['\r'] = true;
+    dfa->special['\n'] = true;
+
+    for (i = 0; i < n; ++i) {
+        const unsigned char *s = (const unsigned char *)tbl[i].str;
+        size_t len = strlen(tbl[i].str);
+        int state = 0;
+        size_t pos;
+
+        for (pos = 0; pos < len; ++pos) {
+            int *row = dfa->delta + state * 256;
+
+            if (row[s[pos]] < 0) {
+                int nstate = dfa->nstates++;
+
+                memset(dfa->delta + nstate * 256, 0xff, 256 * sizeof (int));
+                row[s[pos]] = nstate;
+            }
+            state = row[s[pos]];
+        }
+        if (dfa->accept[state] == 0) {
+            dfa->accept[state] = tbl[i].suchar;
+        }
+
+        dfa->special[s[0]] = true;
+        if (len == 1) {
+            dfa->direct[s[0]] = tbl[i].suchar;
+        }
+        if (len > dfa->maxlen) {
+            dfa->maxlen = len;
+        }
+    }
+
+    dfa->nstop = 0;
+    for (i = 0; i < 256; ++i) {
+        if (dfa->special[i]) {
+            if (dfa->nstop < MAX_STOP_BYTES) {
+                memset(dfa->stopv[dfa->nstop], (int)i, 32);
+            }
+            ++dfa->nstop;
+        }
+    }
+    skip_select(dfa, simd_auto);
+}
+
+void
+marker_dfa_free(marker_dfa_t *dfa)
+{
+    free(dfa->delta);
+    free(dfa->accept);
+    dfa->delta = NULL;
+    dfa->accept = NULL;
+    dfa->nstates = 0;
+}
+
+/**
+ * @brief Match the bytes at |p| against the compiled markers.
+ * @param dfa   IN   The compiled markers.
+ * @param p     IN   Input bytes.
+ * @param n     IN   Number of bytes available at |p|.
+ * @param lenp  OUT  Length of the marker, if one matched.
+ * @return The super-character for the shortest marker that is
+ * a prefix of the input; 0 if no marker matches; or -1 if we cannot
+ * tell yet, because all |n| bytes are a proper prefix of some marker.
+ *
+ * Walking stops at the first accepting state, or at the first dead
+ * transition, so at most |dfa->maxlen| bytes are examined.
+ */
+int
+marker_dfa_match(const marker_dfa_t *dfa, const char *p, size_t n, size_t *lenp)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    int state = 0;
+    size_t i;
+
+    if (n != 0 && dfa->direct[u[0]] != 0) {
+        *lenp = 1;
+        return (dfa->direct[u[0]]);
+    }
+
+    for (i = 0; i < n; ++i) {
+        state = dfa->delta[state * 256 + u[i]];
+        if (state < 0) {
+            return (0);
+        }
+        if (dfa->accept[state] != 0) {
+            *lenp = i + 1;
+            return (dfa->accept[state]);
+        }
+    }
+    return (-1);
+}
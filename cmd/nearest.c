@@ -0,0 +1,396 @@
+/*
+ * Filename: src/cmd/nearest.c
+ * Project: wdiff-align
+ * Brief: Index of recent lines, to find the earlier line most like a new one
+ *
+ * Description:
+ *   In a real history, unrelated lines are interleaved, so a line
+ *   is often not a change to the line right before it, but to one
+ *   further back.  For --series --nearest, each new line is compared
+ *   with the most similar earlier line, instead.
+ *
+ *   Similarity is the Jaccard index of the sets of 3-byte shingles
+ *   of two lines, estimated by MinHash (Broder, "On the resemblance
+ *   and containment of documents", 1997):  of NEAR_HASHES hash functions,
+ *   the fraction for which the two lines have the same least hash
+ *   of any shingle.  Shingles, rather than words, so that a small
+ *   change to one word leaves most of a line the same.
+ *
+ *   Lines with similar signatures are found by locality-sensitive
+ *   hashing:  the signature is cut into NEAR_BANDS bands, and each
+ *   band is a key into a hash table of buckets.  Two lines that are
+ *   50% similar share a band with a probability of over 98%;
+ *   two that are 10% similar, about 15%.  Only the few lines in the
+ *   buckets of a new line's bands are candidates, and only the few
+ *   of those that share the most bands are compared in full,
+ *   so the cost of a lookup does not grow with the number of lines.
+ *
+ *   Memory is bounded:  the index keeps the most recent lines that fit,
+ *   in rings of entries and of text, and each bucket keeps only its
+ *   NEAR_WAYS most recent lines.  An older line drops out when its
+ *   entry or its text is overwritten, which is detected at lookup.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+    // Import type size_t
+#include <stdint.h>
+    // Import type uint16_t
+    // Import type uint32_t
+    // Import type uint64_t
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+    // Import memmove()
+    // Import memset()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+#define NEAR_ROWS (NEAR_HASHES / NEAR_BANDS)
+
+// log2(NEAR_HASHES), the bits of a hash that choose its bin
+
+#define NEAR_BIN_BITS 5
+
+// At most this many candidates are compared in full.
+
+#define NEAR_VERIFY 4
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (k);
+}
+
+/*
+ * Compute the MinHash signature of the set of 3-byte shingles of |line|;
+ * a line shorter than that is a shingle of its own.
+ *
+ * This is one-permutation MinHash (Li, Owen and Zhang, 2012):
+ * one hash of each shingle, whose top bits pick one of NEAR_HASHES bins,
+ * and the least hash in each bin, instead of the least of each of
+ * NEAR_HASHES hash functions.  An empty bin borrows from the next
+ * bin that is not empty, mixed with the distance to it (Shrivastava
+ * and Li, "Densifying one permutation hashing via rotation", 2014).
+ * Return false if |line| is empty.
+ */
+static bool
+signature(const char *line, size_t len, uint16_t *sig)
+{
+    const unsigned char *p = (const unsigned char *)line;
+    uint64_t minv[NEAR_HASHES];
+    size_t nsh;
+    size_t i;
+    int k;
+
+    if (len == 0) {
+        return (false);
+    }
+    for (k = 0; k < NEAR_HASHES; ++k) {
+        minv[k] = UINT64_MAX;
+    }
+
+    nsh = len >= 3 ? len - 2 : 1;
+    for (i = 0; i < nsh; ++i) {
+        uint64_t h;
+        int bin;
+
+        if (len >= 3) {
+            h = ((uint64_t)p[i] << 16) | ((uint64_t)p[i + 1] << 8) | p[i + 2];
+        }
+        else {
+            h = (1ULL << 24) | ((uint64_t)p[0] << 8) | (len == 2 ? p[1] : 0);
+        }
+        h = fmix64(h);
+        bin = h >> (64 - NEAR_BIN_BITS);
+        h &= UINT64_MAX >> NEAR_BIN_BITS;
+        if (h < minv[bin]) {
+            minv[bin] = h;
+        }
+    }
+
+    for (k = 0; k < NEAR_HASHES; ++k) {
+        uint64_t h = minv[k];
+        int d;
+
+        for (d = 1; h == UINT64_MAX; ++d) {
+            h = minv[(k + d) % NEAR_HASHES];
+            if (h != UINT64_MAX) {
+                h = fmix64(h + d) >> NEAR_BIN_BITS;
+            }
+        }
+        sig[k] = h >> (64 - NEAR_BIN_BITS - 16);
+    }
+    return (true);
+}
+
+static inline uint32_t *
+bucket(const nearest_t *nx, const uint16_t *sig, int band)
+{
+    const uint16_t *row = sig + band * NEAR_ROWS;
+    uint64_t key = band;
+    int r;
+
+    for (r = 0; r < NEAR_ROWS; ++r) {
+        key = (key << 16) | row[r];
+    }
+    return (nx->slotv + (fmix64(key) & (nx->slotc - 1)) * NEAR_WAYS);
+}
+
+/*
+ * Is line |id|, which would be in entry |e|, still in the index?
+ * The entry may have been reused, or the text overwritten.
+ */
+static inline bool
+is_live(const nearest_t *nx, const near_ent_t *e, uint32_t id)
+{
+    return (e->id == id && nx->tend <= e->voff + nx->tcap);
+}
+
+/*
+ * How many lines ago line |id| was added.  Ids wrap around,
+ * so they are compared by this, never by value.
+ */
+static inline uint32_t
+id_age(const nearest_t *nx, uint32_t id)
+{
+    return (nx->next_id - id);
+}
+
+/**
+ * @brief Set up an empty index of at most |max| bytes.
+ * @param nx       OUT  The index.
+ * @param max      IN   Cap on the memory of the index.
+ * @param min_pct  IN   How similar, in percent, a line must be to be found.
+ * @return void
+ *
+ * A quarter of |max| is for text, and the rest for entries and buckets,
+ * 144 bytes a line;  with lines of 50 bytes or so, that is about
+ * 5 million lines per GiB.
+ * Memory is allocated zero-filled, and only touched as it is used.
+ */
+void
+nearest_init(nearest_t *nx, size_t max, unsigned min_pct)
+{
+    size_t per_line;
+    size_t nbuckets;
+
+    memset(nx, 0, sizeof (*nx));
+    per_line = sizeof (near_ent_t) + NEAR_BANDS * sizeof (uint32_t);
+    nx->tcap = max / 4 > 0 ? max / 4 : 1;
+    nx->entc = (max - max / 4) / per_line > 0 ? (max - max / 4) / per_line : 1;
+    nbuckets = nx->entc * NEAR_BANDS / NEAR_WAYS;
+    nx->slotc = 1;
+    while (nx->slotc * 2 <= nbuckets) {
+        nx->slotc *= 2;
+    }
+    nx->text = guard_malloc(nx->tcap);
+    nx->entv = guard_calloc(nx->entc, sizeof (near_ent_t));
+    nx->slotv = guard_calloc(nx->slotc * NEAR_WAYS, sizeof (uint32_t));
+    nx->next_id = 1;
+    nx->min_pct = min_pct;
+}
+
+void
+nearest_free(nearest_t *nx)
+{
+    free(nx->text);
+    free(nx->entv);
+    free(nx->slotv);
+    memset(nx, 0, sizeof (*nx));
+}
+
+/**
+ * @brief Find the line in the index most similar to |line|.
+ * @param nx    IN/OUT  The index.
+ * @param line  IN      The new line.
+ * @param len   IN      Length of |line|.
+ * @param lenp  OUT     Length of the line found.
+ * @return The text of the line found, or NULL if no line is at least
+ *         |min_pct| similar.  Of equally similar lines, the most recent.
+ *
+ * The text is in the index, and is good only until the next nearest_add().
+ * The signature of |line| is kept for nearest_add() of the same line.
+ */
+const char *
+nearest_find(nearest_t *nx, const char *line, size_t len, size_t *lenp)
+{
+    const uint32_t *bkv[NEAR_BANDS];
+    uint32_t idv[NEAR_BANDS * NEAR_WAYS];
+    int hitv[NEAR_BANDS * NEAR_WAYS];
+    const near_ent_t *topv[NEAR_VERIFY];
+    uint32_t topid[NEAR_VERIFY];
+    size_t idc = 0;
+    size_t topc;
+    const near_ent_t *best = NULL;
+    unsigned bestn = 0;
+    uint16_t *sig = nx->qsig;
+    int band;
+    size_t v;
+
+    nx->qline = NULL;
+    if (!signature(line, len, sig)) {
+        return (NULL);
+    }
+    nx->qline = line;
+    nx->qlen = len;
+
+    /*
+     * The buckets are all over memory.  Ask for them all at once,
+     * rather than wait for each in turn.
+     */
+    for (band = 0; band < NEAR_BANDS; ++band) {
+        bkv[band] = bucket(nx, sig, band);
+        __builtin_prefetch(bkv[band]);
+    }
+
+    // Count the bands each candidate shares with |line|.
+    for (band = 0; band < NEAR_BANDS; ++band) {
+        const uint32_t *bk = bkv[band];
+        int w;
+
+        for (w = 0; w < NEAR_WAYS && bk[w] != 0; ++w) {
+            size_t i;
+
+            for (i = 0; i < idc && idv[i] != bk[w]; ++i) {
+            }
+            if (i == idc) {
+                idv[idc] = bk[w];
+                hitv[idc] = 0;
+                ++idc;
+            }
+            ++hitv[i];
+        }
+    }
+
+    /*
+     * The more bands a line shares, the more similar it is likely
+     * to be.  Only the NEAR_VERIFY candidates with the most are
+     * looked at, and their signatures compared in full.
+     * Of equals, the most recent is first.
+     */
+    topc = 0;
+    while (topc < NEAR_VERIFY && idc != 0) {
+        size_t top = 0;
+        size_t i;
+
+        for (i = 1; i < idc; ++i) {
+            if (hitv[i] > hitv[top]
+                || (hitv[i] == hitv[top] && id_age(nx, idv[i]) < id_age(nx, idv[top]))) {
+                top = i;
+            }
+        }
+        topid[topc] = idv[top];
+        topv[topc] = nx->entv + idv[top] % nx->entc;
+        __builtin_prefetch(topv[topc]);
+        ++topc;
+        --idc;
+        idv[top] = idv[idc];
+        hitv[top] = hitv[idc];
+    }
+
+    for (v = 0; v < topc; ++v) {
+        const near_ent_t *e = topv[v];
+        unsigned n;
+        int k;
+
+        if (!is_live(nx, e, topid[v])) {
+            continue;
+        }
+        n = 0;
+        for (k = 0; k < NEAR_HASHES; ++k) {
+            n += e->sig[k] == sig[k];
+        }
+        if (n > bestn
+            || (n == bestn && best != NULL && id_age(nx, e->id) < id_age(nx, best->id))) {
+            best = e;
+            bestn = n;
+        }
+    }
+
+    if (best == NULL || bestn * 100 < nx->min_pct * NEAR_HASHES) {
+        return (NULL);
+    }
+    *lenp = best->len;
+    return (nx->text + best->voff % nx->tcap);
+}
+
+/**
+ * @brief Add |line| to the index, as the most recent line.
+ * @param nx    IN/OUT  The index.
+ * @param line  IN      The line.
+ * @param len   IN      Length of |line|.
+ * @return void
+ *
+ * An empty line, or one too long to keep, is not added.
+ * If |line| was just looked up by nearest_find(), its signature is reused.
+ */
+void
+nearest_add(nearest_t *nx, const char *line, size_t len)
+{
+    uint16_t sig[NEAR_HASHES];
+    near_ent_t *e;
+    uint32_t id;
+    size_t phys;
+    int band;
+
+    if (line == nx->qline && len == nx->qlen) {
+        memcpy(sig, nx->qsig, sizeof (sig));
+    }
+    else if (!signature(line, len, sig)) {
+        return;
+    }
+    nx->qline = NULL;
+    if (len > nx->tcap) {
+        return;
+    }
+    id = nx->next_id;
+    nx->next_id = id + 1 != 0 ? id + 1 : 1;
+    e = nx->entv + id % nx->entc;
+
+    // Text is never split across the end of the ring.
+    phys = nx->tend % nx->tcap;
+    if (phys + len > nx->tcap) {
+        nx->tend += nx->tcap - phys;
+    }
+    e->id = id;
+    e->len = len;
+    e->voff = nx->tend;
+    memcpy(e->sig, sig, sizeof (sig));
+    memcpy(nx->text + nx->tend % nx->tcap, line, len);
+    nx->tend += len;
+
+    for (band = 0; band < NEAR_BANDS; ++band) {
+        uint32_t *bk = bucket(nx, e->sig, band);
+
+        memmove(bk + 1, bk, (NEAR_WAYS - 1) * sizeof (uint32_t));
+        bk[0] = id;
+    }
+}
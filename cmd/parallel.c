@@ -0,0 +1,546 @@
+/*
+ * Filename: src/cmd/parallel.c
+ * Project: wdiff-align
+ * Brief: Align many input files at once, on a pool of threads
+ *
+ * Description:
+ *   Each input file is an independent job.  Worker threads take
+ *   the next job from a shared queue as soon as they are idle,
+ *   so that a few large files do not hold up all the small ones.
+ *
+ *   A large regular file is split into chunks of whole lines,
+ *   and each chunk is a job of its own.  Lines are independent,
+ *   except for the insert/delete state carried from one line to
+ *   the next.  So, first, each chunk is scanned, in parallel,
+ *   for just its markers, giving the state at its end for each
+ *   possible state at its start.  Chaining those together gives
+ *   the state at the start of every chunk, and then the chunks
+ *   can be rendered in parallel.
+ *
+ *   Output stays in command-line order.  A job that is the next
+ *   one due to be written when it is taken writes straight to the
+ *   output;  any other job renders into a memory buffer, which is
+ *   written out when its turn comes, and so are its warnings,
+ *   each at its place in the output.  To bound the memory used,
+ *   workers do not get more than a few jobs ahead of the output,
+ *   and buffers that have been written out are reused.
+ *
+ *   All parsing and rendering state is per-job;  the only thing
+ *   shared is the compiled marker DFA, which is read-only.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+    // Import stat()
+
+#include <pthread.h>
+    // Import pthread_cond_broadcast()
+    // Import pthread_cond_wait()
+    // Import pthread_create()
+    // Import pthread_join()
+    // Import pthread_mutex_lock()
+    // Import pthread_mutex_unlock()
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdio.h>
+    // Import type FILE
+    // Import fileno()
+    // Import fwrite()
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memchr()
+#include <sys/stat.h>
+    // Import stat()
+    // Import S_ISREG()
+#include <unistd.h>
+    // Import isatty()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+extern const char *program_name;
+
+// How many jobs, per worker, may be buffered ahead of the output
+
+#define JOBS_AHEAD 2
+
+// Files larger than this are split into chunks of about this size
+
+#define CHUNK_SIZE (8 * 1024 * 1024)
+
+/*
+ * A job is either a whole file, named by |fname|,
+ * or a chunk of whole lines of a memory-mapped file,
+ * |buf| through |buf + len|.
+ *
+ * For a chunk, |effect| maps the insert/delete state at the start
+ * of the chunk to the state at its end, and |state| is the actual
+ * state at its start.  |first| marks the first chunk of a file.
+ *
+ * A job that is not |direct| keeps its output in |out|, and its
+ * warnings in |heldv|, until its turn comes to be written out.
+ */
+struct job {
+    const char *fname;
+    const char *buf;
+    size_t     len;
+    int        effect[N_STATES];
+    int        state;
+    char       *out;
+    size_t     outlen;
+    size_t     outsz;
+    held_warning_t *heldv;
+    size_t     heldc;
+    int        err;
+    bool       first;
+    bool       direct;
+    bool       done;
+};
+
+typedef struct job job_t;
+
+struct pool {
+    job_t              *jobv;
+    size_t             jobc;
+    size_t             jobsz;
+    size_t             next;
+    size_t             head;
+    size_t             window;
+    char               **freev;
+    size_t             *freeszv;
+    size_t             freec;
+    FILE               *dstf;
+    const marker_dfa_t *dfa;
+    bool               color;
+    bool               show_midline;
+    size_t             fold;
+    bool               fine;
+    int                format;
+    bool               columns;
+    stats_t            *stats;
+    pthread_mutex_t    lock;
+    pthread_cond_t     cond;
+};
+
+typedef struct pool pool_t;
+
+static job_t *
+add_job(pool_t *pool, const char *fname)
+{
+    job_t *job;
+
+    if (pool->jobc == pool->jobsz) {
+        pool->jobsz = pool->jobsz ? 2 * pool->jobsz : 64;
+        pool->jobv = guard_realloc(pool->jobv, pool->jobsz * sizeof (job_t));
+    }
+    job = &pool->jobv[pool->jobc++];
+    memset(job, 0, sizeof (*job));
+    job->fname = fname;
+    return (job);
+}
+
+/*
+ * Split a memory-mapped file into chunks that end at a newline.
+ */
+static void
+add_chunks(pool_t *pool, const input_t *in)
+{
+    const char *buf = in->map;
+    const char *end = buf + in->maplen;
+    bool first = true;
+
+    while (buf < end) {
+        const char *eol = end;
+        job_t *job;
+
+        if ((size_t)(end - buf) > CHUNK_SIZE) {
+            eol = memchr(buf + CHUNK_SIZE, '\n', end - buf - CHUNK_SIZE);
+            eol = eol ? eol + 1 : end;
+        }
+        job = add_job(pool, in->fname);
+        job->buf = buf;
+        job->len = eol - buf;
+        job->first = first;
+        first = false;
+        buf = eol;
+    }
+}
+
+/*
+ * Run |fn| on |nthreads| threads.
+ */
+static pthread_t *
+start_threads(pool_t *pool, size_t nthreads, void *(*fn)(void *))
+{
+    pthread_t *tidv;
+    size_t i;
+
+    tidv = guard_calloc(nthreads, sizeof (pthread_t));
+    for (i = 0; i < nthreads; ++i) {
+        int err = pthread_create(&tidv[i], NULL, fn, pool);
+        if (err) {
+            eprintf("%s: pthread_create() failed.\n", program_name);
+            eexplain_err(err);
+            exit(2);
+        }
+    }
+    return (tidv);
+}
+
+static void
+join_threads(pthread_t *tidv, size_t nthreads)
+{
+    size_t i;
+
+    for (i = 0; i < nthreads; ++i) {
+        pthread_join(tidv[i], NULL);
+    }
+    free(tidv);
+}
+
+/*
+ * Find the insert/delete state at the end of a chunk,
+ * for each state it could start in.
+ */
+static void
+chunk_effect(pool_t *pool, job_t *job)
+{
+    scan_t scan;
+    span_t span;
+    int s;
+
+    for (s = 0; s < N_STATES; ++s) {
+        job->effect[s] = s;
+    }
+    scan_init_mem(&scan, job->buf, job->len, pool->dfa);
+    while (scan_next(&scan, &span)) {
+        if (span.kind == span_text || span.kind == span_eol) {
+            continue;
+        }
+        for (s = 0; s < N_STATES; ++s) {
+            job->effect[s] = marker_state(job->effect[s], span.kind);
+        }
+    }
+    scan_free(&scan);
+}
+
+static void *
+effect_worker(void *arg)
+{
+    pool_t *pool = arg;
+    double t_parse = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->jobc) {
+        job_t *job = &pool->jobv[pool->next++];
+        double t0;
+
+        if (job->buf == NULL) {
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        t0 = pool->stats ? stats_clock() : 0;
+        chunk_effect(pool, job);
+        if (pool->stats != NULL) {
+            t_parse += stats_clock() - t0;
+        }
+        pthread_mutex_lock(&pool->lock);
+    }
+    if (pool->stats != NULL) {
+        pool->stats->t_parse += t_parse;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return (NULL);
+}
+
+/*
+ * Align one job.  Output is written straight to |dstf|
+ * if the job is direct, else kept in the renderer's buffer.
+ */
+static int
+align_job(pool_t *pool, job_t *job, align_t *a)
+{
+    input_t in;
+    scan_t scan;
+    int err;
+
+    a->dstf = job->direct ? pool->dstf : NULL;
+    a->in_insert = (job->state == state_insert);
+    a->in_delete = (job->state == state_delete);
+
+    if (job->buf != NULL) {
+        scan_init_mem(&scan, job->buf, job->len, pool->dfa);
+        err = align_scan(a, &scan);
+        scan_free(&scan);
+        return (err);
+    }
+
+    err = input_open(&in, job->fname);
+    if (err) {
+        return (err);
+    }
+    scan_init_input(&scan, &in, pool->dfa);
+    err = align_scan(a, &scan);
+    scan_free(&scan);
+    input_close(&in);
+    return (err);
+}
+
+static void *
+align_worker(void *arg)
+{
+    pool_t *pool = arg;
+    align_t align;
+    stats_t stats;
+
+    align_init(&align, NULL, pool->color, pool->show_midline);
+    align.tty = isatty(fileno(pool->dstf));
+    align.fold = pool->fold;
+    align.fine = pool->fine;
+    align.format = pool->format;
+    align.columns = pool->columns;
+    stats_init(&stats);
+    if (pool->stats != NULL) {
+        align.stats = &stats;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->jobc) {
+        job_t *job;
+
+        if (pool->next >= pool->head + pool->window) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+
+        job = &pool->jobv[pool->next];
+        job->direct = (pool->next == pool->head);
+        ++pool->next;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->err = align_job(pool, job, &align);
+
+        pthread_mutex_lock(&pool->lock);
+        if (!job->direct) {
+            // Hand over the output, and take a spare buffer, if any.
+            job->out = align.obuf;
+            job->outlen = align.olen;
+            job->outsz = align.osz;
+            job->heldv = align.heldv;
+            job->heldc = align.heldc;
+            align.obuf = NULL;
+            align.olen = 0;
+            align.osz = 0;
+            align.heldv = NULL;
+            align.heldc = 0;
+            align.heldsz = 0;
+            if (pool->freec != 0) {
+                --pool->freec;
+                align.obuf = pool->freev[pool->freec];
+                align.osz = pool->freeszv[pool->freec];
+            }
+        }
+        job->done = true;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    if (pool->stats != NULL) {
+        stats_merge(pool->stats, &stats);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    align_free(&align);
+    return (NULL);
+}
+
+/**
+ * @brief Align the wdiff output in many files, using |njobs| threads.
+ * @param filec         IN  Number of files.
+ * @param filev         IN  File names;  "-" means stdin.
+ * @param dstf          IN  Write all output here, in order.
+ * @param dfa           IN  The compiled markers.
+ * @param color         IN  Color deletions red and insertions green.
+ * @param show_midline  IN  Show the middle line of +/- markers.
+ * @param fold          IN  Fold lines into bands this wide, unless 0.
+ * @param fine          IN  Diff changed word pairs character by character.
+ * @param format        IN  Write display lines, or records of runs.
+ * @param columns       IN  With records, give each run its display column.
+ * @param njobs         IN  Number of worker threads.
+ * @param stats         IN/OUT  Count what is seen here, unless NULL.
+ * @return 0 on success;  2 if any file could not be read.
+ */
+int
+wdiff_align_parallel(int filec, char **filev, FILE *dstf, const marker_dfa_t *dfa,
+                     bool color, bool show_midline, size_t fold, bool fine,
+                     int format, bool columns, size_t njobs, stats_t *stats)
+{
+    pool_t pool;
+    input_t *inv;
+    pthread_t *tidv;
+    stats_t wstats;
+    size_t nthreads;
+    size_t i;
+    int f;
+    int state;
+    int rv;
+
+    pool.jobv = NULL;
+    pool.jobc = 0;
+    pool.jobsz = 0;
+    pool.next = 0;
+    pool.head = 0;
+    pool.window = njobs * JOBS_AHEAD;
+    pool.freev = guard_calloc(pool.window, sizeof (char *));
+    pool.freeszv = guard_calloc(pool.window, sizeof (size_t));
+    pool.freec = 0;
+    pool.dstf = dstf;
+    pool.dfa = dfa;
+    pool.color = color;
+    pool.show_midline = show_midline;
+    pool.fold = fold;
+    pool.fine = fine;
+    pool.format = format;
+    pool.columns = columns;
+    pool.stats = stats;
+    stats_init(&wstats);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    /*
+     * Large regular files are opened here, to be split into chunks.
+     * Any other file is opened by the worker that aligns it.
+     */
+    inv = guard_calloc(filec, sizeof (input_t));
+    for (f = 0; f < filec; ++f) {
+        struct stat st;
+
+        inv[f].fd = -1;
+        if (strcmp(filev[f], "-") == 0
+            || stat(filev[f], &st) != 0 || !S_ISREG(st.st_mode)
+            || st.st_size <= 2 * CHUNK_SIZE) {
+            add_job(&pool, filev[f]);
+            continue;
+        }
+        if (input_open(&inv[f], filev[f]) != 0 || inv[f].map == NULL) {
+            input_close(&inv[f]);
+            add_job(&pool, filev[f]);
+            continue;
+        }
+        add_chunks(&pool, &inv[f]);
+    }
+
+    nthreads = njobs < pool.jobc ? njobs : pool.jobc;
+
+    /*
+     * Find the insert/delete state at the start of each chunk.
+     * Every file starts in the plain state.
+     */
+    tidv = start_threads(&pool, nthreads, effect_worker);
+    join_threads(tidv, nthreads);
+    state = state_plain;
+    for (i = 0; i < pool.jobc; ++i) {
+        job_t *job = &pool.jobv[i];
+
+        if (job->buf == NULL || job->first) {
+            state = state_plain;
+        }
+        job->state = state;
+        state = job->effect[state];
+    }
+
+    /*
+     * Align all jobs, writing out finished jobs in order.
+     */
+    pool.next = 0;
+    tidv = start_threads(&pool, nthreads, align_worker);
+    rv = 0;
+    pthread_mutex_lock(&pool.lock);
+    while (pool.head < pool.jobc) {
+        job_t *job = &pool.jobv[pool.head];
+
+        if (!job->done) {
+            pthread_cond_wait(&pool.cond, &pool.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        if (job->outlen != 0 || job->heldc != 0) {
+            double t0 = stats ? stats_clock() : 0;
+            size_t off = 0;
+
+            // Each warning goes after the output before it.
+            for (i = 0; i < job->heldc; ++i) {
+                fwrite(job->out + off, 1, job->heldv[i].off - off, dstf);
+                fflush(dstf);
+                align_print_warning(job->heldv[i].cancel);
+                off = job->heldv[i].off;
+            }
+            fwrite(job->out + off, 1, job->outlen - off, dstf);
+            if (stats != NULL) {
+                wstats.t_io += stats_clock() - t0;
+                wstats.bytes_written += job->outlen;
+            }
+        }
+        free(job->heldv);
+        job->heldv = NULL;
+        if (job->err) {
+            fflush(dstf);
+            eprintf("%s: cannot read '%s'.\n", program_name, job->fname);
+            eexplain_err(job->err);
+            rv = 2;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        if (job->out != NULL) {
+            if (pool.freec < pool.window) {
+                pool.freev[pool.freec] = job->out;
+                pool.freeszv[pool.freec] = job->outsz;
+                ++pool.freec;
+            }
+            else {
+                free(job->out);
+            }
+            job->out = NULL;
+        }
+        ++pool.head;
+        pthread_cond_broadcast(&pool.cond);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    join_threads(tidv, nthreads);
+    if (stats != NULL) {
+        stats_merge(stats, &wstats);
+    }
+
+    for (f = 0; f < filec; ++f) {
+        if (inv[f].map != NULL) {
+            input_close(&inv[f]);
+        }
+    }
+    free(inv);
+    while (pool.freec != 0) {
+        free(pool.freev[--pool.freec]);
+    }
+    free(pool.freev);
+    free(pool.freeszv);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.jobv);
+    return (rv);
+}
@@ -0,0 +1,337 @@
+/*
+ * Filename: src/cmd/scan.c
+ * Project: wdiff-align
+ * Brief: Block reader and span tokenizer for the output of wdiff
+ *
+ * Description:
+ *   Read the output of wdiff in large blocks, using read(2),
+ *   and break it up into spans:  runs of plain text, start/end
+ *   of insert/delete markers, and line terminators.
+ *   Plain text is never copied here;  a span points into the
+ *   read buffer, and the consumer can copy it in bulk.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+    // Import var errno
+    // Import constant EINTR
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+    // Import memmove()
+#include <unistd.h>
+    // Import read()
+    // Import type size_t
+    // Import type ssize_t
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+#define SCAN_BUFSZ (256 * 1024)
+
+/*
+ * Markers are translated to Super-Unicode characters.
+ *
+ * Super-Unicode is a fictitious character set that includes extra
+ * wide characters that cannot appear in ordinary Unicode, and can
+ * safely be used to represent our own super-characters, such as
+ * {start of insert, end of insert, start of delete, end of delete}.
+ *
+ * These super-characters cannot occur in the input file.
+ * They must be represented by some sequence of characters.
+ * Here, we translate those input sequences to super-characters,
+ * so that all other program logic need not deal with multi-byte
+ * sequences.
+ */
+
+void
+scan_init(scan_t *sc, int fd, const marker_dfa_t *dfa)
+{
+    sc->fd = fd;
+    sc->own = true;
+    sc->bufsz = SCAN_BUFSZ;
+    sc->buf = guard_malloc(sc->bufsz);
+    sc->pos = 0;
+    sc->end = 0;
+    sc->eof = false;
+    sc->err = 0;
+    sc->dfa = dfa;
+    sc->stats = NULL;
+}
+
+/**
+ * @brief Set up a scanner over input that is already all in memory.
+ * @param sc   OUT  The scanner.
+ * @param buf  IN   The input, for example a memory-mapped file.
+ * @param len  IN   Length of the input.
+ * @param dfa  IN   The compiled markers.
+ * @return void
+ *
+ * Spans point directly into |buf|;  nothing is copied.
+ */
+void
+scan_init_mem(scan_t *sc, const char *buf, size_t len, const marker_dfa_t *dfa)
+{
+    sc->fd = -1;
+    sc->own = false;
+    sc->bufsz = len;
+    sc->buf = (char *)buf;
+    sc->pos = 0;
+    sc->end = len;
+    sc->eof = true;
+    sc->err = 0;
+    sc->dfa = dfa;
+    sc->stats = NULL;
+}
+
+/*
+ * Set up a scanner over an input file, mapped or not.
+ */
+void
+scan_init_input(scan_t *sc, const input_t *in, const marker_dfa_t *dfa)
+{
+    if (in->map != NULL) {
+        scan_init_mem(sc, in->map, in->maplen, dfa);
+    }
+    else {
+        scan_init(sc, in->fd, dfa);
+    }
+}
+
+/**
+ * @brief Set up a scanner for input that is pushed to it,
+ *        a piece at a time, using scan_push().
+ * @param sc   OUT  The scanner.
+ * @param dfa  IN   The compiled markers.
+ * @return void
+ *
+ * scan_next() returns false whenever it has used up all the input
+ * pushed so far.  A marker that is cut off at the end of one piece
+ * is held back until the next piece, or until scan_push_end().
+ */
+void
+scan_init_push(scan_t *sc, const marker_dfa_t *dfa)
+{
+    sc->fd = -1;
+    sc->own = true;
+    sc->bufsz = 0;
+    sc->buf = NULL;
+    sc->pos = 0;
+    sc->end = 0;
+    sc->eof = false;
+    sc->err = 0;
+    sc->dfa = dfa;
+    sc->stats = NULL;
+}
+
+/**
+ * @brief Add a piece of input to a push scanner.
+ * @param sc   IN/OUT  The scanner.
+ * @param buf  IN      The input.  It is copied.
+ * @param len  IN      Length of the input.
+ * @return void
+ */
+void
+scan_push(scan_t *sc, const char *buf, size_t len)
+{
+    size_t keep = sc->end - sc->pos;
+
+    if (keep != 0 && sc->pos != 0) {
+        memmove(sc->buf, sc->buf + sc->pos, keep);
+    }
+    sc->pos = 0;
+    sc->end = keep;
+
+    if (keep + len > sc->bufsz) {
+        sc->bufsz = sc->bufsz ? sc->bufsz : 4096;
+        while (sc->bufsz < keep + len) {
+            sc->bufsz *= 2;
+        }
+        sc->buf = guard_realloc(sc->buf, sc->bufsz);
+    }
+    memcpy(sc->buf + sc->end, buf, len);
+    sc->end += len;
+    sc->eof = false;
+    if (sc->stats != NULL) {
+        sc->stats->bytes_read += len;
+    }
+}
+
+/**
+ * @brief Tell a push scanner that there is no more input.
+ *
+ * Anything held back, waiting to see if it is a marker, is plain text.
+ */
+void
+scan_push_end(scan_t *sc)
+{
+    sc->eof = true;
+}
+
+void
+scan_free(scan_t *sc)
+{
+    if (sc->own) {
+        free(sc->buf);
+    }
+    sc->buf = NULL;
+}
+
+/*
+ * Keep any unconsumed bytes, moving them to the start of the buffer,
+ * and read as much more as will fit.
+ * Return false if no more bytes could be read.
+ */
+static bool
+scan_fill(scan_t *sc)
+{
+    size_t keep;
+    ssize_t n;
+    double t0;
+
+    if (sc->eof || sc->fd < 0) {
+        return (false);
+    }
+
+    keep = sc->end - sc->pos;
+    if (keep != 0 && sc->pos != 0) {
+        memmove(sc->buf, sc->buf + sc->pos, keep);
+    }
+    sc->pos = 0;
+    sc->end = keep;
+
+    t0 = sc->stats ? stats_clock() : 0;
+    while (true) {
+        n = read(sc->fd, sc->buf + sc->end, sc->bufsz - sc->end);
+        if (n >= 0 || errno != EINTR) {
+            break;
+        }
+    }
+    if (sc->stats != NULL) {
+        sc->stats->t_io += stats_clock() - t0;
+        if (n > 0) {
+            sc->stats->bytes_read += n;
+        }
+    }
+
+    if (n <= 0) {
+        if (n < 0) {
+            sc->err = errno;
+        }
+        sc->eof = true;
+        return (false);
+    }
+
+    sc->end += n;
+    return (true);
+}
+
+/**
+ * @brief Get the next span of wdiff output.
+ * @param sc  IN/OUT  The scanner.
+ * @param sp  OUT     The span.
+ * @return false at end of input, else true.
+ *
+ * A span is one of:
+ *   span_text     a run of plain text, with no line terminators;
+ *   span_eol      a single carriage return or newline;
+ *   insert_start, insert_end, delete_start, delete_end
+ *                 a complete marker.
+ *
+ * |sp->ptr| points into the read buffer, and is valid only until
+ * the next call to scan_next().
+ *
+ * A marker that is cut off by the end of the read buffer is put
+ * together again after the next read.  An incomplete marker at the
+ * end of input is just plain text.  With a push scanner, false
+ * also means that all input pushed so far has been used up.
+ */
+bool
+scan_next(scan_t *sc, span_t *sp)
+{
+    const char *p;
+    size_t n;
+    size_t i;
+    int c;
+
+    while (sc->pos == sc->end) {
+        if (!scan_fill(sc)) {
+            return (false);
+        }
+    }
+
+    p = sc->buf + sc->pos;
+    n = sc->end - sc->pos;
+    c = p[0] & 0xff;
+    i = 0;
+
+    /*
+     * A run of plain text ends at a line terminator,
+     * or at any byte that could start a marker.
+     */
+    if (sc->dfa->special[c]) {
+        if (c == '\r' || c == '\n') {
+            sp->kind = span_eol;
+            sp->ptr = p;
+            sp->len = 1;
+            sc->pos += 1;
+            return (true);
+        }
+
+        while (true) {
+            size_t len;
+            int suchar = marker_dfa_match(sc->dfa, p, n, &len);
+
+            if (suchar > 0) {
+                sp->kind = suchar;
+                sp->ptr = p;
+                sp->len = len;
+                sc->pos += len;
+                return (true);
+            }
+            if (suchar == 0) {
+                break;
+            }
+            if (!scan_fill(sc)) {
+                if (!sc->eof) {
+                    // More input may yet be pushed;  wait for it.
+                    return (false);
+                }
+                break;
+            }
+            p = sc->buf + sc->pos;
+            n = sc->end - sc->pos;
+        }
+
+        // Not a marker, so the first byte is plain text.
+        i = 1;
+    }
+
+    i += sc->dfa->skip(sc->dfa, p + i, n - i);
+
+    sp->kind = span_text;
+    sp->ptr = p;
+    sp->len = i;
+    sc->pos += i;
+    return (true);
+}
@@ -0,0 +1,284 @@
+/*
+ * Filename: src/cmd/series.c
+ * Project: wdiff-align
+ * Brief: Align a series of changes, one line at a time
+ *
+ * Description:
+ *   Treat the lines of input as a series of changes, from one line
+ *   to the next.  For each pair of lines, compute the word diff
+ *   and show the difference as horizontally aligned before and after
+ *   lines, with the middle line of +/- markers.
+ *
+ *   This used to be done by the Perl script, wdiff-align-series,
+ *   which wrote each pair of lines to temporary files, ran wdiff,
+ *   and then ran wdiff-align, for every pair.  Here, everything
+ *   is done in-process, and only the previous line is kept.
+ *
+ *   With --nearest, each line is compared instead with the most
+ *   similar of the recent lines before it.  See nearest.c.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+    // Import getline()
+
+#include <errno.h>
+    // Import var errno
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+    // Import ferror()
+    // Import getline()
+    // Import snprintf()
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+void
+series_init(series_t *s, FILE *dstf, bool ltrim, bool rtrim, bool color)
+{
+    word_diff_init(&s->wd);
+    s->wd.ltrim = ltrim;
+    s->wd.rtrim = rtrim;
+    align_init(&s->align, dstf, color, true);
+    s->cache = NULL;
+    s->near = NULL;
+    s->copts[0] = '\0';
+    s->prev = NULL;
+    s->prevlen = 0;
+    s->prevsz = 0;
+    s->ndiffs = 0;
+}
+
+void
+series_free(series_t *s)
+{
+    word_diff_free(&s->wd);
+    align_free(&s->align);
+    free(s->prev);
+    s->prev = NULL;
+    s->prevlen = 0;
+    s->prevsz = 0;
+}
+
+static void
+series_diff(series_t *s, const char *line, size_t len)
+{
+    word_diff(&s->wd, s->prev, s->prevlen, line, len);
+    align_edits(&s->align, s->wd.editv, s->wd.editc);
+    align_eol(&s->align);
+}
+
+/*
+ * Same as series_diff(), but take the rendered output from the cache,
+ * if it is there, else render it and add it to the cache.
+ * The options that change the output are part of the key.
+ */
+static void
+series_cached(series_t *s, const char *line, size_t len)
+{
+    const align_t *a = &s->align;
+    uint64_t key[2];
+    const char *out;
+    size_t outlen;
+    size_t start;
+
+    if (s->copts[0] == '\0') {
+        snprintf(s->copts, sizeof (s->copts),
+            "series color=%d trim=%d,%d elide=%zu fold=%zu fine=%d diff=%d fmt=%d,%d",
+            a->color, s->wd.ltrim, s->wd.rtrim, s->wd.elide_min,
+            a->fold, a->fine, s->wd.algorithm, a->format, a->columns);
+    }
+    cache_key(s->cache, key, s->copts, s->prev, s->prevlen, line, len);
+    out = cache_get(s->cache, key, &outlen);
+    if (out != NULL) {
+        align_puts(&s->align, out, outlen);
+        if (s->align.stats != NULL) {
+            ++s->align.stats->records;
+        }
+        return;
+    }
+
+    s->align.hold = true;
+    start = s->align.olen;
+    series_diff(s, line, len);
+    cache_put(s->cache, key, s->align.obuf + start, s->align.olen - start);
+    s->align.hold = false;
+}
+
+/*
+ * Compare |line| with the previous line, and show the pair.
+ */
+static void
+series_pair(series_t *s, const char *line, size_t len)
+{
+    if (s->ndiffs && s->align.format == format_text) {
+        align_puts(&s->align, "\n\n", 2);
+    }
+    if (s->cache != NULL) {
+        series_cached(s, line, len);
+    }
+    else {
+        series_diff(s, line, len);
+    }
+    ++s->ndiffs;
+}
+
+/*
+ * Keep a copy of |line|, as the previous line.
+ */
+static void
+series_keep(series_t *s, const char *line, size_t len)
+{
+    if (len > s->prevsz) {
+        s->prevsz = len * 2;
+        free(s->prev);
+        s->prev = guard_malloc(s->prevsz);
+    }
+    memcpy(s->prev, line, len);
+    s->prevlen = len;
+}
+
+/**
+ * @brief Compare one more line of the series with the line before it.
+ * @param s     IN/OUT  State of the series.
+ * @param line  IN      The new line, without its line terminator.
+ * @param len   IN      Length of |line|.
+ * @return void
+ *
+ * A line after an empty line is not compared with it;
+ * the empty line starts a new series.  But an empty line is compared
+ * with the line before it, and so is shown as its "after" line,
+ * with all of it deleted.
+ *
+ * With an index of similar lines, |line| is compared instead with
+ * the most similar earlier line.  If none is similar enough,
+ * |line| is not compared with anything, but starts a new chain.
+ */
+void
+series_line(series_t *s, const char *line, size_t len)
+{
+    if (s->near != NULL) {
+        const char *match;
+        size_t mlen;
+
+        match = nearest_find(s->near, line, len, &mlen);
+        if (match != NULL) {
+            series_keep(s, match, mlen);
+        }
+        nearest_add(s->near, line, len);
+        if (match != NULL) {
+            series_pair(s, line, len);
+        }
+        return;
+    }
+
+    if (s->prevlen != 0) {
+        series_pair(s, line, len);
+    }
+    series_keep(s, line, len);
+}
+
+/**
+ * @brief Make |line| the previous line, without comparing it to anything.
+ * @param s     IN/OUT  State of the series.
+ * @param line  IN      The line, without its line terminator.
+ * @param len   IN      Length of |line|.
+ * @return void
+ *
+ * With an index of similar lines, |line| is added to the index.
+ */
+void
+series_seed(series_t *s, const char *line, size_t len)
+{
+    if (s->near != NULL) {
+        nearest_add(s->near, line, len);
+    }
+    else {
+        series_keep(s, line, len);
+    }
+}
+
+/**
+ * @brief Read lines from |srcf| and feed them to series_line().
+ * @param s     IN/OUT  State of the series.
+ * @param srcf  IN      Input stream.
+ * @return 0 on success, else the errno value from a failed read.
+ *
+ * A trailing CR, as in CR-LF line endings, is removed.
+ * If the renderer keeps statistics, time spent in getline() is I/O,
+ * and the rest, apart from rendering, is parsing.
+ */
+int
+series_align(series_t *s, FILE *srcf)
+{
+    stats_t *st = s->align.stats;
+    char *line = NULL;
+    size_t linesz = 0;
+    ssize_t len;
+    double t0 = 0;
+    double prev = 0;
+    int err;
+
+    if (st != NULL) {
+        t0 = stats_clock();
+        prev = st->t_render + st->t_io;
+    }
+
+    while (true) {
+        if (st != NULL) {
+            double t1 = stats_clock();
+
+            len = getline(&line, &linesz, srcf);
+            st->t_io += stats_clock() - t1;
+            if (len > 0) {
+                st->bytes_read += len;
+            }
+        }
+        else {
+            len = getline(&line, &linesz, srcf);
+        }
+        if (len == -1) {
+            break;
+        }
+        if (len != 0 && line[len - 1] == '\n') {
+            --len;
+        }
+        if (len != 0 && line[len - 1] == '\r') {
+            --len;
+        }
+        series_line(s, line, len);
+    }
+    align_flush(&s->align);
+    if (st != NULL) {
+        stats_add_parse(st, t0, prev);
+    }
+
+    err = ferror(srcf) ? errno : 0;
+    free(line);
+    return (err);
+}
@@ -0,0 +1,642 @@
+/*
+ * Filename: src/cmd/serve.c
+ * Project: wdiff-align
+ * Brief: Resident server, aligning requests over a Unix socket
+ *
+ * Description:
+ *   Instead of starting a process, and perhaps running wdiff, for
+ *   every comparison, a client connects to 'wdiff-align --serve SOCKET'
+ *   and sends requests:  either the output of wdiff, or a pair of texts
+ *   to be diffed natively, along with rendering options.  The protocol
+ *   is described in inc/wdiffalign.h.
+ *
+ *   A fixed pool of worker threads shares one epoll instance.  The
+ *   listening socket and every connection are registered one-shot,
+ *   so that each readiness event goes to exactly one worker, which
+ *   accepts new connections, or reads and writes what it can on one
+ *   connection, and then re-arms the socket.  Connections are
+ *   non-blocking:  a request that has arrived only in part is kept
+ *   with its connection until the rest arrives, and is aligned only
+ *   once it is complete;  a response the client is slow to take is
+ *   kept until the socket is writable.  So, many clients can stay
+ *   connected, and neither idle nor slow clients tie up a worker.
+ *
+ *   Each worker keeps a library context for each combination of
+ *   options, for as long as the server runs;  each connection keeps
+ *   its request and response buffers, so a request does no allocation
+ *   once the connection has seen one as large.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+    // Import type struct sockaddr_un
+
+#include <arpa/inet.h>
+    // Import htonl()
+    // Import ntohl()
+#include <errno.h>
+    // Import var errno
+    // Import constant EAGAIN
+    // Import constant EINTR
+    // Import constant EWOULDBLOCK
+#include <fcntl.h>
+    // Import fcntl()
+    // Import constant O_NONBLOCK
+#include <pthread.h>
+    // Import pthread_create()
+    // Import pthread_join()
+#include <signal.h>
+    // Import sigaction()
+    // Import signal()
+    // Import constant SIGPIPE
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stdint.h>
+    // Import constant UINT32_MAX
+    // Import type uint32_t
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+    // Import memset()
+    // Import strlen()
+#include <sys/epoll.h>
+    // Import epoll_create1()
+    // Import epoll_ctl()
+    // Import epoll_wait()
+#include <sys/socket.h>
+    // Import accept()
+    // Import bind()
+    // Import listen()
+    // Import socket()
+#include <sys/stat.h>
+    // Import lstat()
+    // Import S_ISSOCK()
+#include <sys/uio.h>
+    // Import writev()
+#include <sys/un.h>
+    // Import type struct sockaddr_un
+#include <unistd.h>
+    // Import close()
+    // Import read()
+    // Import unlink()
+
+#include <cscript.h>
+#include <wdiffalign.h>
+#include "wdiff-align.h"
+
+extern const char *program_name;
+
+// Largest request accepted, texts included
+
+#define MAX_REQUEST (256 * 1024 * 1024)
+
+// Largest output, and largest warnings, that a response can carry
+
+#define MAX_RESPONSE UINT32_MAX
+
+#define N_OPTION_SETS (WDA_OPT_MASK + 1)
+
+/*
+ * A growable byte buffer, kept from one request to the next.
+ */
+struct buffer {
+    char   *buf;
+    size_t len;
+    size_t sz;
+};
+
+typedef struct buffer buffer_t;
+
+struct server {
+    int epfd;
+    int lfd;
+};
+
+typedef struct server server_t;
+
+struct worker {
+    server_t *srv;
+    wda_t    *ctxv[N_OPTION_SETS];
+};
+
+typedef struct worker worker_t;
+
+/*
+ * What a connection is waiting for
+ */
+enum {
+    conn_header,
+    conn_body,
+    conn_response,
+};
+
+/*
+ * State of one connection, from one readiness event to the next.
+ * |got| is how much of the request header or body has been read,
+ * |sent| how much of the response has been written.
+ * |last| is set when the connection is to be closed
+ * once the response is sent.
+ */
+struct conn {
+    int      fd;
+    int      state;
+    uint32_t hdr[4];
+    uint32_t rhdr[3];
+    size_t   need;
+    size_t   got;
+    size_t   sent;
+    bool     last;
+    buffer_t req;
+    buffer_t out;
+    buffer_t warn;
+};
+
+typedef struct conn conn_t;
+
+static const char *socket_path;
+
+static void
+buffer_append(buffer_t *b, const char *buf, size_t len)
+{
+    if (b->len + len > b->sz) {
+        size_t sz = b->sz ? b->sz : 65536;
+
+        while (sz < b->len + len) {
+            sz *= 2;
+        }
+        b->buf = guard_realloc(b->buf, sz);
+        b->sz = sz;
+    }
+    memcpy(b->buf + b->len, buf, len);
+    b->len += len;
+}
+
+static void
+sink_out(void *arg, const char *buf, size_t len)
+{
+    buffer_append(arg, buf, len);
+}
+
+static void
+sink_warn(void *arg, const char *msg)
+{
+    buffer_append(arg, msg, strlen(msg));
+    buffer_append(arg, "\n", 1);
+}
+
+/*
+ * Add the part of |buf| not yet sent to |iov|.
+ * |skip| is how much of the response before |buf| has been sent.
+ */
+static int
+iov_add(struct iovec *iov, int iovc, const void *buf, size_t len, size_t *skip)
+{
+    if (*skip >= len) {
+        *skip -= len;
+        return (iovc);
+    }
+    iov[iovc].iov_base = (char *)buf + *skip;
+    iov[iovc].iov_len = len - *skip;
+    *skip = 0;
+    return (iovc + 1);
+}
+
+/*
+ * Write as much of the response as the socket takes.
+ * Return 1 once it is all written, 0 if the socket is full,
+ * or -1 on error.
+ */
+static int
+conn_write(conn_t *c)
+{
+    size_t total = sizeof (c->rhdr) + c->out.len + c->warn.len;
+
+    while (c->sent < total) {
+        struct iovec iov[3];
+        size_t skip = c->sent;
+        int iovc = 0;
+        ssize_t n;
+
+        iovc = iov_add(iov, iovc, c->rhdr, sizeof (c->rhdr), &skip);
+        iovc = iov_add(iov, iovc, c->out.buf, c->out.len, &skip);
+        iovc = iov_add(iov, iovc, c->warn.buf, c->warn.len, &skip);
+        n = writev(c->fd, iov, iovc);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+        }
+        c->sent += n;
+    }
+    return (1);
+}
+
+/*
+ * Read as much of what the connection is waiting for as has arrived.
+ * Return 1 once it is all read, 0 if more is to come,
+ * or -1 on end of file or error.
+ */
+static int
+conn_read(conn_t *c, char *buf)
+{
+    while (c->got < c->need) {
+        ssize_t n = read(c->fd, buf + c->got, c->need - c->got);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return (0);
+        }
+        if (n <= 0) {
+            return (-1);
+        }
+        c->got += n;
+    }
+    return (1);
+}
+
+static void
+respond(conn_t *c, uint32_t status, bool last)
+{
+    c->rhdr[0] = htonl(status);
+    c->rhdr[1] = htonl((uint32_t)c->out.len);
+    c->rhdr[2] = htonl((uint32_t)c->warn.len);
+    c->sent = 0;
+    c->last = last;
+    c->state = conn_response;
+}
+
+/*
+ * The context for a set of options, made the first time it is needed.
+ * Return NULL if memory ran out.
+ */
+static wda_t *
+worker_context(worker_t *w, uint32_t flags)
+{
+    wda_t *ctx = w->ctxv[flags];
+
+    if (ctx == NULL) {
+        wda_options_t opt;
+
+        wda_options_default(&opt);
+        opt.ctrl = (flags & WDA_OPT_CTRL) != 0;
+        opt.show_midline = (flags & WDA_OPT_MIDLINE) != 0;
+        opt.color = (flags & WDA_OPT_COLOR) != 0;
+        opt.fine = (flags & WDA_OPT_FINE) != 0;
+        ctx = wda_new(&opt, NULL);
+        w->ctxv[flags] = ctx;
+    }
+    return (ctx);
+}
+
+/*
+ * The header of a request is complete.  Check it,
+ * and get ready to read the body.
+ */
+static void
+serve_header(conn_t *c)
+{
+    uint32_t type = ntohl(c->hdr[0]);
+    uint32_t flags = ntohl(c->hdr[1]);
+    size_t len1 = ntohl(c->hdr[2]);
+    size_t len2 = ntohl(c->hdr[3]);
+
+    c->out.len = 0;
+    c->warn.len = 0;
+    if ((type != WDA_REQ_WDIFF && type != WDA_REQ_DIFF)
+        || (flags & ~WDA_OPT_MASK) != 0
+        || (type == WDA_REQ_WDIFF && len2 != 0)) {
+        respond(c, WDA_BAD_REQUEST, true);
+        return;
+    }
+    if (len1 + len2 > MAX_REQUEST) {
+        respond(c, WDA_TOO_LARGE, true);
+        return;
+    }
+
+    if (len1 + len2 > c->req.sz) {
+        c->req.sz = len1 + len2;
+        c->req.buf = guard_realloc(c->req.buf, c->req.sz);
+    }
+    c->need = len1 + len2;
+    c->got = 0;
+    c->state = conn_body;
+}
+
+/*
+ * The body of a request is complete.  Align it.
+ * If memory runs out, the context is dropped, to be made afresh
+ * for the next request that needs it, and the server goes on.
+ * Output or warnings too long for the lengths in the response header
+ * are dropped, and the request is refused as too large.
+ */
+static void
+serve_body(worker_t *w, conn_t *c)
+{
+    uint32_t type = ntohl(c->hdr[0]);
+    uint32_t flags = ntohl(c->hdr[1]);
+    size_t len1 = ntohl(c->hdr[2]);
+    size_t len2 = ntohl(c->hdr[3]);
+    wda_t *ctx;
+    int err;
+
+    ctx = worker_context(w, flags);
+    if (ctx == NULL) {
+        respond(c, WDA_NO_MEMORY, true);
+        return;
+    }
+    wda_set_sink(ctx, sink_out, &c->out);
+    wda_set_warn(ctx, sink_warn, &c->warn);
+    if (type == WDA_REQ_WDIFF) {
+        err = wda_push(ctx, c->req.buf, len1);
+        if (err == 0) {
+            err = wda_finish(ctx);
+        }
+    }
+    else {
+        err = wda_diff(ctx, c->req.buf, len1, c->req.buf + len1, len2);
+    }
+    if (err) {
+        wda_free(ctx);
+        w->ctxv[flags] = NULL;
+        c->out.len = 0;
+        c->warn.len = 0;
+        respond(c, WDA_NO_MEMORY, true);
+        return;
+    }
+    if (c->out.len > MAX_RESPONSE || c->warn.len > MAX_RESPONSE) {
+        c->out.len = 0;
+        c->warn.len = 0;
+        respond(c, WDA_TOO_LARGE, true);
+        return;
+    }
+    respond(c, WDA_OK, false);
+}
+
+/*
+ * Make what progress the connection allows:  read the rest of
+ * a request, align it once it is whole, and write the response.
+ * Return the events to wait for next, or 0 if the connection
+ * should be closed.
+ */
+static uint32_t
+serve_conn(worker_t *w, conn_t *c)
+{
+    int rv;
+
+    while (true) {
+        switch (c->state) {
+        case conn_header:
+            rv = conn_read(c, (char *)c->hdr);
+            if (rv <= 0) {
+                return (rv == 0 ? EPOLLIN : 0);
+            }
+            serve_header(c);
+            break;
+        case conn_body:
+            rv = conn_read(c, c->req.buf);
+            if (rv <= 0) {
+                return (rv == 0 ? EPOLLIN : 0);
+            }
+            serve_body(w, c);
+            break;
+        case conn_response:
+            rv = conn_write(c);
+            if (rv <= 0) {
+                return (rv == 0 ? EPOLLOUT : 0);
+            }
+            if (c->last) {
+                return (0);
+            }
+            // Wait for the next request, so that one client
+            // sending request after request does not keep the worker.
+            c->state = conn_header;
+            c->need = sizeof (c->hdr);
+            c->got = 0;
+            return (EPOLLIN);
+        }
+    }
+}
+
+static conn_t *
+conn_new(int fd)
+{
+    conn_t *c = guard_calloc(1, sizeof (conn_t));
+
+    c->fd = fd;
+    c->state = conn_header;
+    c->need = sizeof (c->hdr);
+    return (c);
+}
+
+static void
+conn_free(conn_t *c)
+{
+    close(c->fd);
+    free(c->req.buf);
+    free(c->out.buf);
+    free(c->warn.buf);
+    free(c);
+}
+
+/*
+ * Wait for |events| on |fd|, once.  |c| is the connection,
+ * or NULL for the listening socket.
+ */
+static bool
+rearm(server_t *srv, int fd, conn_t *c, uint32_t events, int op)
+{
+    struct epoll_event ev;
+
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = c;
+    return (epoll_ctl(srv->epfd, op, fd, &ev) == 0);
+}
+
+/*
+ * Accept all pending connections.
+ */
+static void
+accept_all(server_t *srv)
+{
+    int fd;
+
+    while ((fd = accept(srv->lfd, NULL, NULL)) >= 0) {
+        conn_t *c;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        c = conn_new(fd);
+        if (!rearm(srv, fd, c, EPOLLIN, EPOLL_CTL_ADD)) {
+            conn_free(c);
+        }
+    }
+    rearm(srv, srv->lfd, NULL, EPOLLIN, EPOLL_CTL_MOD);
+}
+
+static void *
+serve_worker(void *arg)
+{
+    worker_t *w = arg;
+    server_t *srv = w->srv;
+
+    while (true) {
+        struct epoll_event ev;
+        conn_t *c;
+        uint32_t events;
+        int n;
+
+        n = epoll_wait(srv->epfd, &ev, 1, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            eprintf("%s: epoll_wait() failed.\n", program_name);
+            eexplain_err(errno);
+            break;
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        c = ev.data.ptr;
+        if (c == NULL) {
+            accept_all(srv);
+            continue;
+        }
+        events = serve_conn(w, c);
+        if (events == 0 || !rearm(srv, c->fd, c, events, EPOLL_CTL_MOD)) {
+            conn_free(c);
+        }
+    }
+    return (NULL);
+}
+
+static void
+remove_socket(int sig)
+{
+    unlink(socket_path);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/*
+ * Create the listening socket.  A stale socket left by an earlier
+ * server is removed;  any other kind of file is left alone.
+ */
+static int
+listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof (addr.sun_path)) {
+        eprintf("%s: socket path is too long, '%s'.\n", program_name, path);
+        return (-1);
+    }
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        int err = errno;
+        eprintf("%s: socket() failed.\n", program_name);
+        eexplain_err(err);
+        return (-1);
+    }
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof (addr)) != 0
+        || listen(fd, 128) != 0) {
+        int err = errno;
+        eprintf("%s: cannot listen on '%s'.\n", program_name, path);
+        eexplain_err(err);
+        close(fd);
+        return (-1);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return (fd);
+}
+
+/**
+ * @brief Serve alignment requests on a Unix socket, until killed.
+ * @param path      IN  Path of the socket.
+ * @param nthreads  IN  Number of worker threads.
+ * @return 2 if the server could not be started.
+ *
+ * The socket is removed on SIGINT or SIGTERM.
+ */
+int
+wdiff_align_serve(const char *path, size_t nthreads)
+{
+    server_t srv;
+    worker_t *workv;
+    pthread_t *tidv;
+    struct sigaction sa;
+    size_t i;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    srv.lfd = listen_on(path);
+    if (srv.lfd < 0) {
+        return (2);
+    }
+    socket_path = path;
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = remove_socket;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    srv.epfd = epoll_create1(0);
+    if (srv.epfd < 0) {
+        int err = errno;
+        eprintf("%s: epoll_create1() failed.\n", program_name);
+        eexplain_err(err);
+        unlink(path);
+        return (2);
+    }
+    rearm(&srv, srv.lfd, NULL, EPOLLIN, EPOLL_CTL_ADD);
+
+    workv = guard_calloc(nthreads, sizeof (worker_t));
+    tidv = guard_calloc(nthreads, sizeof (pthread_t));
+    for (i = 0; i < nthreads; ++i) {
+        int err;
+
+        workv[i].srv = &srv;
+        err = pthread_create(&tidv[i], NULL, serve_worker, &workv[i]);
+        if (err) {
+            eprintf("%s: pthread_create() failed.\n", program_name);
+            eexplain_err(err);
+            unlink(path);
+            exit(2);
+        }
+    }
+    for (i = 0; i < nthreads; ++i) {
+        pthread_join(tidv[i], NULL);
+    }
+
+    unlink(path);
+    return (2);
+}
@@ -0,0 +1,174 @@
+/*
+ * Filename: src/cmd/skip-plain.c
+ * Project: wdiff-align
+ * Brief: Fast skip over plain text when scanning the output of wdiff
+ *
+ * Description:
+ *   Most of the output of wdiff is unchanged text.  A run of plain
+ *   text ends only at a byte that could start a marker, or at a line
+ *   terminator.  With the standard or --ctrl markers, there are just
+ *   six such "stop" bytes, so 16 or 32 bytes at a time can be checked
+ *   by comparing against each stop byte, using SSE2 or AVX2.
+ *
+ *   SSE2 is the baseline on x86-64.  AVX2 is used if the CPU has it,
+ *   as determined at run time.  On other machines, or if there are
+ *   too many stop bytes, the scalar table lookup is used.
+ *   All versions give exactly the same result.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+#include <stddef.h>
+    // Import type size_t
+#include <string.h>
+    // Import strcmp()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static size_t
+skip_scalar(const marker_dfa_t *dfa, const char *p, size_t n)
+{
+    const bool *special = dfa->special;
+    size_t i = 0;
+
+    while (i < n && !special[p[i] & 0xff]) {
+        ++i;
+    }
+    return (i);
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("sse2")))
+static size_t
+skip_sse2(const marker_dfa_t *dfa, const char *p, size_t n)
+{
+    size_t nstop = dfa->nstop;
+    size_t i = 0;
+
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i m = _mm_setzero_si128();
+        size_t k;
+        int mask;
+
+        for (k = 0; k < nstop; ++k) {
+            __m128i s = _mm_loadu_si128((const __m128i *)dfa->stopv[k]);
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, s));
+        }
+        mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return (i + __builtin_ctz(mask));
+        }
+        i += 16;
+    }
+    return (i + skip_scalar(dfa, p + i, n - i));
+}
+
+__attribute__((target("avx2")))
+static size_t
+skip_avx2(const marker_dfa_t *dfa, const char *p, size_t n)
+{
+    size_t nstop = dfa->nstop;
+    size_t i = 0;
+
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i m = _mm256_setzero_si256();
+        size_t k;
+        unsigned int mask;
+
+        for (k = 0; k < nstop; ++k) {
+            __m256i s = _mm256_loadu_si256((const __m256i *)dfa->stopv[k]);
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, s));
+        }
+        mask = (unsigned int)_mm256_movemask_epi8(m);
+        if (mask != 0) {
+            return (i + __builtin_ctz(mask));
+        }
+        i += 32;
+    }
+    return (i + skip_sse2(dfa, p + i, n - i));
+}
+
+#endif /* HAVE_X86_SIMD */
+
+static const char *simd_names[] = { "auto", "scalar", "sse2", "avx2" };
+
+/**
+ * @brief Translate the name of a SIMD level to its number.
+ * @param name  IN  One of "auto", "scalar", "sse2", "avx2".
+ * @return The level, or -1 if |name| is not known.
+ */
+int
+simd_level_by_name(const char *name)
+{
+    int level;
+
+    for (level = simd_auto; level <= simd_avx2; ++level) {
+        if (strcmp(name, simd_names[level]) == 0) {
+            return (level);
+        }
+    }
+    return (-1);
+}
+
+const char *
+simd_level_name(int level)
+{
+    return (simd_names[level]);
+}
+
+/**
+ * @brief Choose the function used to skip plain text.
+ * @param dfa    IN/OUT  Compiled markers.
+ * @param level  IN      Highest SIMD level to use, or simd_auto.
+ * @return The level actually used.
+ *
+ * A level that the CPU does not support, or that cannot handle
+ * the number of stop bytes, falls back to the next lower level.
+ */
+int
+skip_select(marker_dfa_t *dfa, int level)
+{
+#ifdef HAVE_X86_SIMD
+    if (dfa->nstop <= MAX_STOP_BYTES) {
+        __builtin_cpu_init();
+        if ((level == simd_auto || level >= simd_avx2) &&
+            __builtin_cpu_supports("avx2")) {
+            dfa->skip = skip_avx2;
+            return (simd_avx2);
+        }
+        if (level == simd_auto || level >= simd_sse2) {
+            dfa->skip = skip_sse2;
+            return (simd_sse2);
+        }
+    }
+#else
+    (void)level;
+#endif
+    dfa->skip = skip_scalar;
+    return (simd_scalar);
+}
@@ -0,0 +1,178 @@
+/*
+ * Filename: src/cmd/stats.c
+ * Project: wdiff-align
+ * Brief: Counters and timers for --stats
+ *
+ * Description:
+ *   The scanner and the renderer each keep a pointer to a stats_t,
+ *   which is NULL unless --stats or --stats-json was given, so that
+ *   an ordinary run pays for nothing but a test of that pointer.
+ *
+ *   Time is split three ways:  rendering is the building of the
+ *   three display lines;  I/O is time spent in read(2), getline()
+ *   and writing the output;  and parsing is everything else, which
+ *   includes scanning for markers, collecting runs, and diffing
+ *   in --diff and --series modes.
+ *
+ *   With -j, every worker thread has its own stats_t, and they are
+ *   added up at the end, so times are summed over all threads.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+    // Import clock_gettime()
+
+#include <stdio.h>
+    // Import type FILE
+    // Import fprintf()
+#include <string.h>
+    // Import memset()
+#include <time.h>
+    // Import clock_gettime()
+    // Import constant CLOCK_MONOTONIC
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+static const char *marker_names[N_MARKERS] = {
+    "insert_start", "insert_end", "delete_start", "delete_end",
+};
+
+void
+stats_init(stats_t *st)
+{
+    memset(st, 0, sizeof (*st));
+}
+
+/**
+ * @brief Current time, in seconds, from a monotonic clock.
+ */
+double
+stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/**
+ * @brief Add the counts and times in |src| to |dst|.
+ * @param dst  IN/OUT  Running total.
+ * @param src  IN      Statistics of one thread.
+ * @return void
+ */
+void
+stats_merge(stats_t *dst, const stats_t *src)
+{
+    size_t i;
+
+    dst->bytes_read += src->bytes_read;
+    dst->bytes_written += src->bytes_written;
+    dst->records += src->records;
+    for (i = 0; i < N_MARKERS; ++i) {
+        dst->markers[i] += src->markers[i];
+    }
+    if (src->width_max > dst->width_max) {
+        dst->width_max = src->width_max;
+    }
+    dst->width_sum += src->width_sum;
+    dst->warnings += src->warnings;
+    dst->t_parse += src->t_parse;
+    dst->t_render += src->t_render;
+    dst->t_io += src->t_io;
+}
+
+/**
+ * @brief Account for the time from |t0| until now, as parsing,
+ *        less any rendering and I/O that was done meanwhile.
+ * @param st    IN/OUT  Statistics.
+ * @param t0    IN      Start time, from stats_clock().
+ * @param prev  IN      st->t_render + st->t_io, at time |t0|.
+ * @return void
+ */
+void
+stats_add_parse(stats_t *st, double t0, double prev)
+{
+    double t = stats_clock() - t0 - (st->t_render + st->t_io - prev);
+
+    if (t > 0) {
+        st->t_parse += t;
+    }
+}
+
+static double
+mean_width(const stats_t *st)
+{
+    return (st->records ? (double)st->width_sum / st->records : 0.0);
+}
+
+/**
+ * @brief Show statistics in a form meant to be read by people.
+ * @param f       IN  Write here, usually stderr.
+ * @param st      IN  Statistics.
+ * @param t_wall  IN  Elapsed time of the whole run.
+ * @return void
+ */
+void
+stats_print(FILE *f, const stats_t *st, double t_wall)
+{
+    size_t nmarkers = 0;
+    size_t i;
+
+    for (i = 0; i < N_MARKERS; ++i) {
+        nmarkers += st->markers[i];
+    }
+
+    fprintf(f, "Bytes read:       %zu\n", st->bytes_read);
+    fprintf(f, "Bytes written:    %zu\n", st->bytes_written);
+    fprintf(f, "Records:          %zu\n", st->records);
+    fprintf(f, "Markers:          %zu\n", nmarkers);
+    for (i = 0; i < N_MARKERS; ++i) {
+        fprintf(f, "  %-16s%zu\n", marker_names[i], st->markers[i]);
+    }
+    fprintf(f, "Line width:       max %zu, mean %.1f\n",
+        st->width_max, mean_width(st));
+    fprintf(f, "Warnings:         %zu\n", st->warnings);
+    fprintf(f, "Time:             %.6f s elapsed\n", t_wall);
+    fprintf(f, "  parse           %.6f s\n", st->t_parse);
+    fprintf(f, "  render          %.6f s\n", st->t_render);
+    fprintf(f, "  I/O             %.6f s\n", st->t_io);
+}
+
+/**
+ * @brief Same as stats_print(), but as a single JSON object.
+ */
+void
+stats_print_json(FILE *f, const stats_t *st, double t_wall)
+{
+    size_t i;
+
+    fprintf(f, "{\"bytes_read\": %zu, \"bytes_written\": %zu,"
+        " \"records\": %zu, \"markers\": {",
+        st->bytes_read, st->bytes_written, st->records);
+    for (i = 0; i < N_MARKERS; ++i) {
+        fprintf(f, "%s\"%s\": %zu", i ? ", " : "",
+            marker_names[i], st->markers[i]);
+    }
+    fprintf(f, "}, \"width_max\": %zu, \"width_mean\": %.1f,"
+        " \"warnings\": %zu, \"seconds\": {\"elapsed\": %.6f,"
+        " \"parse\": %.6f, \"render\": %.6f, \"io\": %.6f}}\n",
+        st->width_max, mean_width(st), st->warnings, t_wall,
+        st->t_parse, st->t_render, st->t_io);
+}
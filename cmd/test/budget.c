@@ -0,0 +1,121 @@
+/*
+ * Filename: src/cmd/test/budget.c
+ * Project: wdiff-align
+ * Brief: Run a command, and fail if it takes too much time or memory
+ *
+ * Description:
+ *   budget SECONDS KIB COMMAND [ARG...]
+ *
+ *   Run COMMAND, with stdin and stdout passed through.
+ *   If it fails, exit with its status.  If it succeeds, but ran
+ *   longer than SECONDS of wall-clock time, or its peak resident
+ *   set size was larger than KIB kilobytes, say so and exit 3.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+    // Import wait4()
+
+#include <errno.h>
+    // Import var errno
+#include <stdio.h>
+    // Import fprintf()
+    // Import var stderr
+#include <stdlib.h>
+    // Import exit()
+    // Import strtod()
+    // Import strtol()
+#include <string.h>
+    // Import strerror()
+#include <sys/resource.h>
+    // Import type struct rusage
+#include <sys/wait.h>
+    // Import wait4()
+    // Import WEXITSTATUS()
+    // Import WIFEXITED()
+#include <time.h>
+    // Import clock_gettime()
+    // Import constant CLOCK_MONOTONIC
+#include <unistd.h>
+    // Import execvp()
+    // Import fork()
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct rusage ru;
+    double max_secs;
+    long max_kib;
+    double t0, secs;
+    pid_t pid;
+    int status;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: budget SECONDS KIB COMMAND [ARG...]\n");
+        exit(2);
+    }
+    max_secs = strtod(argv[1], NULL);
+    max_kib = strtol(argv[2], NULL, 10);
+
+    t0 = now();
+    pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "budget: fork() failed: %s\n", strerror(errno));
+        exit(2);
+    }
+    if (pid == 0) {
+        execvp(argv[3], argv + 3);
+        fprintf(stderr, "budget: cannot run '%s': %s\n",
+            argv[3], strerror(errno));
+        _exit(127);
+    }
+
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        fprintf(stderr, "budget: wait4() failed: %s\n", strerror(errno));
+        exit(2);
+    }
+    secs = now() - t0;
+
+    if (!WIFEXITED(status)) {
+        fprintf(stderr, "budget: '%s' was killed.\n", argv[3]);
+        exit(2);
+    }
+    if (WEXITSTATUS(status) != 0) {
+        exit(WEXITSTATUS(status));
+    }
+    if (secs > max_secs) {
+        fprintf(stderr, "budget: '%s' took %.3f s;  budget is %.3f s.\n",
+            argv[3], secs, max_secs);
+        exit(3);
+    }
+    if (ru.ru_maxrss > max_kib) {
+        fprintf(stderr, "budget: '%s' used %ld KiB;  budget is %ld KiB.\n",
+            argv[3], (long)ru.ru_maxrss, max_kib);
+        exit(3);
+    }
+    exit(0);
+}
@@ -0,0 +1,284 @@
+/*
+ * Filename: src/cmd/test/lib-test.c
+ * Project: wdiff-align
+ * Brief: Exercise libwdiffalign, pushing input in small pieces
+ *
+ * Description:
+ *   lib-test [--ctrl] [-m] [--threads=N] [--enomem=KIB] PIECE FILE
+ *
+ *   Read FILE, and push it to a library context PIECE bytes at a time,
+ *   so that markers are split across pieces.  The aligned output
+ *   should be exactly the same as that of wdiff-align.
+ *
+ *   With --threads=N, N threads each align the whole file at once,
+ *   each with its own context, and all results must be the same.
+ *   The result of the first thread is written to stdout.
+ *
+ *   With --enomem=KIB, first align the file with the address space
+ *   capped at KIB more than it is at the start, which should run out
+ *   of memory;  the library must report that, and not exit.  Then lift
+ *   the cap, and align it again, with a new context.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+    // Import constant ENOMEM
+#include <pthread.h>
+    // Import pthread_create()
+    // Import pthread_join()
+#include <stdbool.h>
+    // Import type bool
+#include <stdio.h>
+    // Import fopen()
+    // Import fprintf()
+    // Import fread()
+    // Import fwrite()
+#include <stdlib.h>
+    // Import exit()
+    // Import free()
+    // Import malloc()
+    // Import realloc()
+    // Import strtoul()
+#include <string.h>
+    // Import memcmp()
+    // Import memcpy()
+    // Import strcmp()
+    // Import strncmp()
+#include <sys/resource.h>
+    // Import getrlimit()
+    // Import setrlimit()
+    // Import type struct rlimit
+#include <unistd.h>
+    // Import sysconf()
+
+#include <wdiffalign.h>
+
+/*
+ * Output of one thread, collected in memory.
+ */
+struct job {
+    wda_options_t opt;
+    const char    *in;
+    size_t        inlen;
+    size_t        piece;
+    char          *out;
+    size_t        outlen;
+    size_t        outsz;
+    int           err;
+};
+
+typedef struct job job_t;
+
+static void
+collect(void *arg, const char *buf, size_t len)
+{
+    job_t *job = arg;
+
+    if (job->outlen + len > job->outsz) {
+        job->outsz = 2 * (job->outlen + len);
+        job->out = realloc(job->out, job->outsz);
+        if (job->out == NULL) {
+            fprintf(stderr, "lib-test: out of memory\n");
+            exit(2);
+        }
+    }
+    memcpy(job->out + job->outlen, buf, len);
+    job->outlen += len;
+}
+
+static void *
+run_job(void *arg)
+{
+    job_t *job = arg;
+    wda_t *ctx;
+    size_t pos;
+
+    ctx = wda_new(&job->opt, NULL);
+    if (ctx == NULL) {
+        job->err = ENOMEM;
+        return (NULL);
+    }
+    wda_set_sink(ctx, collect, job);
+    for (pos = 0; pos < job->inlen && job->err == 0; pos += job->piece) {
+        size_t n = job->inlen - pos;
+
+        job->err = wda_push(ctx, job->in + pos, n < job->piece ? n : job->piece);
+    }
+    if (job->err == 0) {
+        job->err = wda_finish(ctx);
+    }
+    wda_free(ctx);
+    return (NULL);
+}
+
+/*
+ * Size of the address space of this process, in bytes.
+ */
+static size_t
+vm_size(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    size_t pages = 0;
+
+    if (f == NULL || fscanf(f, "%zu", &pages) != 1) {
+        fprintf(stderr, "lib-test: cannot read /proc/self/statm\n");
+        exit(2);
+    }
+    fclose(f);
+    return (pages * sysconf(_SC_PAGESIZE));
+}
+
+/*
+ * Align the file once with the address space capped, which must
+ * fail with WDA_ENOMEM, and leave the process running.
+ */
+static void
+run_enomem(job_t *job, size_t kib)
+{
+    struct rlimit saved, rl;
+
+    getrlimit(RLIMIT_AS, &saved);
+    rl = saved;
+    rl.rlim_cur = vm_size() + kib * 1024;
+    if (setrlimit(RLIMIT_AS, &rl) != 0) {
+        fprintf(stderr, "lib-test: setrlimit() failed\n");
+        exit(2);
+    }
+    run_job(job);
+    setrlimit(RLIMIT_AS, &saved);
+    if (job->err != WDA_ENOMEM) {
+        fprintf(stderr, "lib-test: did not run out of memory\n");
+        exit(1);
+    }
+    job->err = 0;
+    job->outlen = 0;
+}
+
+static char *
+slurp(const char *fname, size_t *lenp)
+{
+    FILE *f;
+    char *buf = NULL;
+    size_t len = 0;
+    size_t sz = 0;
+    size_t n;
+
+    f = fopen(fname, "r");
+    if (f == NULL) {
+        fprintf(stderr, "lib-test: cannot open '%s'\n", fname);
+        exit(2);
+    }
+    do {
+        if (len == sz) {
+            sz = sz ? 2 * sz : 65536;
+            buf = realloc(buf, sz);
+            if (buf == NULL) {
+                fprintf(stderr, "lib-test: out of memory\n");
+                exit(2);
+            }
+        }
+        n = fread(buf + len, 1, sz - len, f);
+        len += n;
+    } while (n != 0);
+    fclose(f);
+    *lenp = len;
+    return (buf);
+}
+
+int
+main(int argc, char **argv)
+{
+    wda_options_t opt;
+    pthread_t *tidv;
+    job_t *jobv;
+    size_t nthreads = 1;
+    size_t enomem = 0;
+    size_t piece;
+    char *in;
+    size_t inlen;
+    size_t i;
+    int argi;
+
+    wda_options_default(&opt);
+    for (argi = 1; argi < argc && argv[argi][0] == '-'; ++argi) {
+        if (strcmp(argv[argi], "--ctrl") == 0) {
+            opt.ctrl = true;
+        }
+        else if (strcmp(argv[argi], "-m") == 0) {
+            opt.show_midline = true;
+        }
+        else if (strncmp(argv[argi], "--threads=", 10) == 0) {
+            nthreads = strtoul(argv[argi] + 10, NULL, 10);
+        }
+        else if (strncmp(argv[argi], "--enomem=", 9) == 0) {
+            enomem = strtoul(argv[argi] + 9, NULL, 10);
+        }
+        else {
+            break;
+        }
+    }
+    if (argc - argi != 2 || nthreads == 0) {
+        fprintf(stderr,
+            "usage: lib-test [--ctrl] [-m] [--threads=N] [--enomem=KIB] PIECE FILE\n");
+        exit(2);
+    }
+    piece = strtoul(argv[argi], NULL, 10);
+    if (piece == 0) {
+        piece = 1;
+    }
+    in = slurp(argv[argi + 1], &inlen);
+
+    jobv = calloc(nthreads, sizeof (job_t));
+    tidv = calloc(nthreads, sizeof (pthread_t));
+    for (i = 0; i < nthreads; ++i) {
+        jobv[i].opt = opt;
+        jobv[i].in = in;
+        jobv[i].inlen = inlen;
+        jobv[i].piece = piece;
+    }
+    if (enomem != 0) {
+        run_enomem(&jobv[0], enomem);
+    }
+    for (i = 0; i < nthreads; ++i) {
+        pthread_create(&tidv[i], NULL, run_job, &jobv[i]);
+    }
+    for (i = 0; i < nthreads; ++i) {
+        pthread_join(tidv[i], NULL);
+        if (jobv[i].err != 0) {
+            fprintf(stderr, "lib-test: out of memory\n");
+            exit(2);
+        }
+    }
+
+    for (i = 1; i < nthreads; ++i) {
+        if (jobv[i].outlen != jobv[0].outlen
+            || memcmp(jobv[i].out, jobv[0].out, jobv[0].outlen) != 0) {
+            fprintf(stderr, "lib-test: thread %zu gave different output\n", i);
+            exit(1);
+        }
+    }
+    fwrite(jobv[0].out, 1, jobv[0].outlen, stdout);
+
+    for (i = 0; i < nthreads; ++i) {
+        free(jobv[i].out);
+    }
+    free(jobv);
+    free(tidv);
+    free(in);
+    exit(0);
+}
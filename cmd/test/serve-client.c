@@ -0,0 +1,271 @@
+/*
+ * Filename: src/cmd/test/serve-client.c
+ * Project: wdiff-align
+ * Brief: Send requests to 'wdiff-align --serve'
+ *
+ * Description:
+ *   serve-client [--ctrl] [-m] [--color] [--fine] [--repeat=N] [--stall=N] SOCKET FILE
+ *   serve-client [--ctrl] [-m] [--color] [--fine] [--repeat=N] [--stall=N] SOCKET --diff OLD NEW
+ *
+ *   Send the output of wdiff in FILE, or a pair of texts to be diffed,
+ *   to the server, and write the aligned output to stdout, and any
+ *   warnings to stderr.  With --repeat=N, send the same request N times
+ *   on one connection, and report the mean latency on stderr.
+ *   With --stall=N, first open N more connections, and on each send
+ *   only part of a request, and never the rest, as a slow client would.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+    // Import type struct sockaddr_un
+
+#include <arpa/inet.h>
+    // Import htonl()
+    // Import ntohl()
+#include <stdint.h>
+    // Import type uint32_t
+#include <stdio.h>
+    // Import fopen()
+    // Import fprintf()
+    // Import fread()
+    // Import fwrite()
+#include <stdlib.h>
+    // Import exit()
+    // Import realloc()
+    // Import strtoul()
+#include <string.h>
+    // Import memcpy()
+    // Import memset()
+    // Import strcmp()
+    // Import strlen()
+    // Import strncmp()
+#include <sys/socket.h>
+    // Import connect()
+    // Import socket()
+#include <sys/un.h>
+    // Import type struct sockaddr_un
+#include <time.h>
+    // Import clock_gettime()
+#include <unistd.h>
+    // Import close()
+    // Import read()
+    // Import write()
+
+#include <wdiffalign.h>
+
+static void
+die(const char *msg)
+{
+    fprintf(stderr, "serve-client: %s\n", msg);
+    exit(2);
+}
+
+static char *
+slurp(const char *fname, size_t *lenp)
+{
+    FILE *f;
+    char *buf = NULL;
+    size_t len = 0;
+    size_t sz = 0;
+    size_t n;
+
+    f = fopen(fname, "r");
+    if (f == NULL) {
+        die("cannot open input file");
+    }
+    do {
+        if (len == sz) {
+            sz = sz ? 2 * sz : 65536;
+            buf = realloc(buf, sz);
+            if (buf == NULL) {
+                die("out of memory");
+            }
+        }
+        n = fread(buf + len, 1, sz - len, f);
+        len += n;
+    } while (n != 0);
+    fclose(f);
+    *lenp = len;
+    return (buf);
+}
+
+static void
+write_full(int fd, const char *buf, size_t len)
+{
+    while (len != 0) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n <= 0) {
+            die("write failed");
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void
+read_full(int fd, char *buf, size_t len)
+{
+    while (len != 0) {
+        ssize_t n = read(fd, buf, len);
+
+        if (n <= 0) {
+            die("server closed the connection");
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static int
+connect_to(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path));
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof (addr)) != 0) {
+        die("cannot connect");
+    }
+    return (fd);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t hdr[4];
+    uint32_t rhdr[3];
+    uint32_t type = WDA_REQ_WDIFF;
+    uint32_t flags = 0;
+    size_t repeat = 1;
+    size_t stall = 0;
+    char *text1, *text2 = NULL;
+    size_t len1, len2 = 0;
+    char *out = NULL;
+    size_t outsz = 0;
+    double t0;
+    size_t i;
+    int argi;
+    int fd;
+
+    for (argi = 1; argi < argc && argv[argi][0] == '-'; ++argi) {
+        if (strcmp(argv[argi], "--ctrl") == 0) {
+            flags |= WDA_OPT_CTRL;
+        }
+        else if (strcmp(argv[argi], "-m") == 0) {
+            flags |= WDA_OPT_MIDLINE;
+        }
+        else if (strcmp(argv[argi], "--color") == 0) {
+            flags |= WDA_OPT_COLOR;
+        }
+        else if (strcmp(argv[argi], "--fine") == 0) {
+            flags |= WDA_OPT_FINE;
+        }
+        else if (strncmp(argv[argi], "--repeat=", 9) == 0) {
+            repeat = strtoul(argv[argi] + 9, NULL, 10);
+        }
+        else if (strncmp(argv[argi], "--stall=", 8) == 0) {
+            stall = strtoul(argv[argi] + 8, NULL, 10);
+        }
+        else {
+            break;
+        }
+    }
+
+    if (argc - argi == 4 && strcmp(argv[argi + 1], "--diff") == 0) {
+        type = WDA_REQ_DIFF;
+        text1 = slurp(argv[argi + 2], &len1);
+        text2 = slurp(argv[argi + 3], &len2);
+    }
+    else if (argc - argi == 2) {
+        text1 = slurp(argv[argi + 1], &len1);
+    }
+    else {
+        die("usage: serve-client [--ctrl] [-m] [--color] [--fine] [--repeat=N]"
+            " [--stall=N] SOCKET { FILE | --diff OLD NEW }");
+    }
+
+    hdr[0] = htonl(type);
+    hdr[1] = htonl(flags);
+    hdr[2] = htonl((uint32_t)len1);
+    hdr[3] = htonl((uint32_t)len2);
+
+    // Half of them stop in the header, half in the body.
+    // They are closed only on exit.
+    for (i = 0; i < stall; ++i) {
+        int sfd = connect_to(argv[argi]);
+
+        if (i % 2 == 0) {
+            write_full(sfd, (char *)hdr, sizeof (hdr) / 2);
+        }
+        else {
+            write_full(sfd, (char *)hdr, sizeof (hdr));
+            write_full(sfd, text1, len1 / 2);
+        }
+    }
+
+    fd = connect_to(argv[argi]);
+
+    t0 = now();
+    for (i = 0; i < repeat; ++i) {
+        size_t outlen, warnlen;
+
+        write_full(fd, (char *)hdr, sizeof (hdr));
+        write_full(fd, text1, len1);
+        write_full(fd, text2, len2);
+
+        read_full(fd, (char *)rhdr, sizeof (rhdr));
+        if (ntohl(rhdr[0]) != WDA_OK) {
+            die("request failed");
+        }
+        outlen = ntohl(rhdr[1]);
+        warnlen = ntohl(rhdr[2]);
+        if (outlen + warnlen > outsz) {
+            outsz = outlen + warnlen;
+            out = realloc(out, outsz);
+            if (out == NULL) {
+                die("out of memory");
+            }
+        }
+        read_full(fd, out, outlen + warnlen);
+
+        if (i == 0) {
+            fwrite(out, 1, outlen, stdout);
+            fwrite(out + outlen, 1, warnlen, stderr);
+        }
+    }
+    if (repeat > 1) {
+        fprintf(stderr, "serve-client: %zu requests, mean latency %.1f us\n",
+            repeat, (now() - t0) / repeat * 1e6);
+    }
+
+    close(fd);
+    exit(0);
+}
@@ -0,0 +1,447 @@
+/*
+ * Filename: src/cmd/utf8-width.c
+ * Project: wdiff-align
+ * Brief: Display width of UTF-8 text, with a fast path for ASCII
+ *
+ * Description:
+ *   The "before" and "after" lines are kept aligned by padding
+ *   with spaces, so the renderer needs to know how many columns
+ *   a run of text takes on a terminal.  For ASCII, that is one
+ *   column per byte.  Other text is decoded as UTF-8, and each
+ *   character takes 0, 1 or 2 columns, as with wcwidth(3):
+ *   combining marks and format characters take none, East Asian
+ *   wide and fullwidth characters, and most emoji, take two.
+ *   The tables are compiled in, so the result does not depend
+ *   on the locale.  A byte that is not part of a valid UTF-8
+ *   sequence takes one column, as it does on most terminals.
+ *
+ *   Most text is ASCII, so a run is first checked for bytes
+ *   with the high bit set, 16 at a time using SSE2, where it is
+ *   available, else 8 at a time in a machine word.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import type size_t
+#include <stdint.h>
+    // Import type uint64_t
+#include <string.h>
+    // Import memcpy()
+
+#include "wdiff-align.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+struct interval {
+    unsigned long first;
+    unsigned long last;
+};
+
+typedef struct interval interval_t;
+
+/*
+ * Characters that take no columns:  combining marks (Mn, Me),
+ * format characters (Cf), Hangul medial vowels and final consonants,
+ * and variation selectors.
+ */
+static const interval_t zero_width[] = {
+    { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD },
+    { 0x05BF, 0x05BF }, { 0x05C1, 0x05C2 }, { 0x05C4, 0x05C5 },
+    { 0x05C7, 0x05C7 }, { 0x0600, 0x0605 }, { 0x0610, 0x061A },
+    { 0x061C, 0x061C }, { 0x064B, 0x065F }, { 0x0670, 0x0670 },
+    { 0x06D6, 0x06DD }, { 0x06DF, 0x06E4 }, { 0x06E7, 0x06E8 },
+    { 0x06EA, 0x06ED }, { 0x070F, 0x070F }, { 0x0711, 0x0711 },
+    { 0x0730, 0x074A }, { 0x07A6, 0x07B0 }, { 0x07EB, 0x07F3 },
+    { 0x0816, 0x0819 }, { 0x081B, 0x0823 }, { 0x0825, 0x0827 },
+    { 0x0829, 0x082D }, { 0x0859, 0x085B }, { 0x08D3, 0x0902 },
+    { 0x093A, 0x093A }, { 0x093C, 0x093C }, { 0x0941, 0x0948 },
+    { 0x094D, 0x094D }, { 0x0951, 0x0957 }, { 0x0962, 0x0963 },
+    { 0x0981, 0x0981 }, { 0x09BC, 0x09BC }, { 0x09C1, 0x09C4 },
+    { 0x09CD, 0x09CD }, { 0x09E2, 0x09E3 }, { 0x0A01, 0x0A02 },
+    { 0x0A3C, 0x0A3C }, { 0x0A41, 0x0A42 }, { 0x0A47, 0x0A48 },
+    { 0x0A4B, 0x0A4D }, { 0x0A51, 0x0A51 }, { 0x0A70, 0x0A71 },
+    { 0x0A75, 0x0A75 }, { 0x0A81, 0x0A82 }, { 0x0ABC, 0x0ABC },
+    { 0x0AC1, 0x0AC5 }, { 0x0AC7, 0x0AC8 }, { 0x0ACD, 0x0ACD },
+    { 0x0AE2, 0x0AE3 }, { 0x0B01, 0x0B01 }, { 0x0B3C, 0x0B3C },
+    { 0x0B3F, 0x0B3F }, { 0x0B41, 0x0B44 }, { 0x0B4D, 0x0B4D },
+    { 0x0B56, 0x0B56 }, { 0x0B62, 0x0B63 }, { 0x0B82, 0x0B82 },
+    { 0x0BC0, 0x0BC0 }, { 0x0BCD, 0x0BCD }, { 0x0C00, 0x0C00 },
+    { 0x0C3E, 0x0C40 }, { 0x0C46, 0x0C48 }, { 0x0C4A, 0x0C4D },
+    { 0x0C55, 0x0C56 }, { 0x0C62, 0x0C63 }, { 0x0C81, 0x0C81 },
+    { 0x0CBC, 0x0CBC }, { 0x0CBF, 0x0CBF }, { 0x0CC6, 0x0CC6 },
+    { 0x0CCC, 0x0CCD }, { 0x0CE2, 0x0CE3 }, { 0x0D00, 0x0D01 },
+    { 0x0D41, 0x0D44 }, { 0x0D4D, 0x0D4D }, { 0x0D62, 0x0D63 },
+    { 0x0DCA, 0x0DCA }, { 0x0DD2, 0x0DD4 }, { 0x0DD6, 0x0DD6 },
+    { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E },
+    { 0x0EB1, 0x0EB1 }, { 0x0EB4, 0x0EBC }, { 0x0EC8, 0x0ECD },
+    { 0x0F18, 0x0F19 }, { 0x0F35, 0x0F35 }, { 0x0F37, 0x0F37 },
+    { 0x0F39, 0x0F39 }, { 0x0F71, 0x0F7E }, { 0x0F80, 0x0F84 },
+    { 0x0F86, 0x0F87 }, { 0x0F8D, 0x0FBC }, { 0x0FC6, 0x0FC6 },
+    { 0x102D, 0x1030 }, { 0x1032, 0x1037 }, { 0x1039, 0x103A },
+    { 0x103D, 0x103E }, { 0x1058, 0x1059 }, { 0x105E, 0x1060 },
+    { 0x1071, 0x1074 }, { 0x1082, 0x1082 }, { 0x1085, 0x1086 },
+    { 0x108D, 0x108D }, { 0x109D, 0x109D }, { 0x1160, 0x11FF },
+    { 0x135D, 0x135F }, { 0x1712, 0x1714 }, { 0x1732, 0x1734 },
+    { 0x1752, 0x1753 }, { 0x1772, 0x1773 }, { 0x17B4, 0x17B5 },
+    { 0x17B7, 0x17BD }, { 0x17C6, 0x17C6 }, { 0x17C9, 0x17D3 },
+    { 0x17DD, 0x17DD }, { 0x180B, 0x180E }, { 0x18A9, 0x18A9 },
+    { 0x1920, 0x1922 }, { 0x1927, 0x1928 }, { 0x1932, 0x1932 },
+    { 0x1939, 0x193B }, { 0x1A17, 0x1A18 }, { 0x1A1B, 0x1A1B },
+    { 0x1A56, 0x1A56 }, { 0x1A58, 0x1A60 }, { 0x1A62, 0x1A62 },
+    { 0x1A65, 0x1A6C }, { 0x1A73, 0x1A7F }, { 0x1AB0, 0x1AFF },
+    { 0x1B00, 0x1B03 }, { 0x1B34, 0x1B34 }, { 0x1B36, 0x1B3A },
+    { 0x1B3C, 0x1B3C }, { 0x1B42, 0x1B42 }, { 0x1B6B, 0x1B73 },
+    { 0x1B80, 0x1B81 }, { 0x1BA2, 0x1BA5 }, { 0x1BA8, 0x1BA9 },
+    { 0x1BAB, 0x1BAD }, { 0x1BE6, 0x1BE6 }, { 0x1BE8, 0x1BE9 },
+    { 0x1BED, 0x1BED }, { 0x1BEF, 0x1BF1 }, { 0x1C2C, 0x1C33 },
+    { 0x1C36, 0x1C37 }, { 0x1CD0, 0x1CD2 }, { 0x1CD4, 0x1CE0 },
+    { 0x1CE2, 0x1CE8 }, { 0x1CED, 0x1CED }, { 0x1CF4, 0x1CF4 },
+    { 0x1CF8, 0x1CF9 }, { 0x1DC0, 0x1DFF }, { 0x200B, 0x200F },
+    { 0x202A, 0x202E }, { 0x2060, 0x2064 }, { 0x2066, 0x206F },
+    { 0x20D0, 0x20F0 }, { 0x2CEF, 0x2CF1 }, { 0x2D7F, 0x2D7F },
+    { 0x2DE0, 0x2DFF }, { 0x302A, 0x302D }, { 0x3099, 0x309A },
+    { 0xA66F, 0xA672 }, { 0xA674, 0xA67D }, { 0xA69E, 0xA69F },
+    { 0xA6F0, 0xA6F1 }, { 0xA802, 0xA802 }, { 0xA806, 0xA806 },
+    { 0xA80B, 0xA80B }, { 0xA825, 0xA826 }, { 0xA8C4, 0xA8C5 },
+    { 0xA8E0, 0xA8F1 }, { 0xA8FF, 0xA8FF }, { 0xA926, 0xA92D },
+    { 0xA947, 0xA951 }, { 0xA980, 0xA982 }, { 0xA9B3, 0xA9B3 },
+    { 0xA9B6, 0xA9B9 }, { 0xA9BC, 0xA9BD }, { 0xA9E5, 0xA9E5 },
+    { 0xAA29, 0xAA2E }, { 0xAA31, 0xAA32 }, { 0xAA35, 0xAA36 },
+    { 0xAA43, 0xAA43 }, { 0xAA4C, 0xAA4C }, { 0xAA7C, 0xAA7C },
+    { 0xAAB0, 0xAAB0 }, { 0xAAB2, 0xAAB4 }, { 0xAAB7, 0xAAB8 },
+    { 0xAABE, 0xAABF }, { 0xAAC1, 0xAAC1 }, { 0xAAEC, 0xAAED },
+    { 0xAAF6, 0xAAF6 }, { 0xABE5, 0xABE5 }, { 0xABE8, 0xABE8 },
+    { 0xABED, 0xABED }, { 0xD7B0, 0xD7FF }, { 0xFB1E, 0xFB1E },
+    { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F }, { 0xFEFF, 0xFEFF },
+    { 0xFFF9, 0xFFFB }, { 0x101FD, 0x101FD }, { 0x102E0, 0x102E0 },
+    { 0x10376, 0x1037A }, { 0x10A01, 0x10A03 }, { 0x10A05, 0x10A06 },
+    { 0x10A0C, 0x10A0F }, { 0x10A38, 0x10A3A }, { 0x10A3F, 0x10A3F },
+    { 0x10AE5, 0x10AE6 }, { 0x10D24, 0x10D27 }, { 0x10F46, 0x10F50 },
+    { 0x11001, 0x11001 }, { 0x11038, 0x11046 }, { 0x1107F, 0x11081 },
+    { 0x110B3, 0x110B6 }, { 0x110B9, 0x110BA }, { 0x110BD, 0x110BD },
+    { 0x110CD, 0x110CD }, { 0x11100, 0x11102 }, { 0x11127, 0x1112B },
+    { 0x1112D, 0x11134 }, { 0x11173, 0x11173 }, { 0x11180, 0x11181 },
+    { 0x111B6, 0x111BE }, { 0x111C9, 0x111CC }, { 0x1122F, 0x11231 },
+    { 0x11234, 0x11234 }, { 0x11236, 0x11237 }, { 0x1123E, 0x1123E },
+    { 0x112DF, 0x112DF }, { 0x112E3, 0x112EA }, { 0x11300, 0x11301 },
+    { 0x1133B, 0x1133C }, { 0x11340, 0x11340 }, { 0x11366, 0x1136C },
+    { 0x11370, 0x11374 }, { 0x16AF0, 0x16AF4 }, { 0x16B30, 0x16B36 },
+    { 0x16F8F, 0x16F92 }, { 0x1BC9D, 0x1BC9E }, { 0x1BCA0, 0x1BCA3 },
+    { 0x1D167, 0x1D169 }, { 0x1D173, 0x1D182 }, { 0x1D185, 0x1D18B },
+    { 0x1D1AA, 0x1D1AD }, { 0x1D242, 0x1D244 }, { 0x1DA00, 0x1DA36 },
+    { 0x1DA3B, 0x1DA6C }, { 0x1DA75, 0x1DA75 }, { 0x1DA84, 0x1DA84 },
+    { 0x1DA9B, 0x1DA9F }, { 0x1DAA1, 0x1DAAF }, { 0x1E000, 0x1E006 },
+    { 0x1E008, 0x1E018 }, { 0x1E01B, 0x1E021 }, { 0x1E023, 0x1E024 },
+    { 0x1E026, 0x1E02A }, { 0x1E8D0, 0x1E8D6 }, { 0x1E944, 0x1E94A },
+    { 0xE0001, 0xE0001 }, { 0xE0020, 0xE007F }, { 0xE0100, 0xE01EF },
+};
+
+/*
+ * Characters that take two columns:  East Asian Wide (W) and
+ * Fullwidth (F), including the emoji that are shown wide.
+ */
+static const interval_t double_width[] = {
+    { 0x1100, 0x115F }, { 0x231A, 0x231B }, { 0x2329, 0x232A },
+    { 0x23E9, 0x23EC }, { 0x23F0, 0x23F0 }, { 0x23F3, 0x23F3 },
+    { 0x25FD, 0x25FE }, { 0x2614, 0x2615 }, { 0x2648, 0x2653 },
+    { 0x267F, 0x267F }, { 0x2693, 0x2693 }, { 0x26A1, 0x26A1 },
+    { 0x26AA, 0x26AB }, { 0x26BD, 0x26BE }, { 0x26C4, 0x26C5 },
+    { 0x26CE, 0x26CE }, { 0x26D4, 0x26D4 }, { 0x26EA, 0x26EA },
+    { 0x26F2, 0x26F3 }, { 0x26F5, 0x26F5 }, { 0x26FA, 0x26FA },
+    { 0x26FD, 0x26FD }, { 0x2705, 0x2705 }, { 0x270A, 0x270B },
+    { 0x2728, 0x2728 }, { 0x274C, 0x274C }, { 0x274E, 0x274E },
+    { 0x2753, 0x2755 }, { 0x2757, 0x2757 }, { 0x2795, 0x2797 },
+    { 0x27B0, 0x27B0 }, { 0x27BF, 0x27BF }, { 0x2B1B, 0x2B1C },
+    { 0x2B50, 0x2B50 }, { 0x2B55, 0x2B55 }, { 0x2E80, 0x303E },
+    { 0x3041, 0x33FF }, { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF },
+    { 0xA000, 0xA4CF }, { 0xA960, 0xA97F }, { 0xAC00, 0xD7A3 },
+    { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6F },
+    { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x16FE0, 0x16FE4 },
+    { 0x17000, 0x18AFF }, { 0x1B000, 0x1B16F }, { 0x1F004, 0x1F004 },
+    { 0x1F0CF, 0x1F0CF }, { 0x1F18E, 0x1F18E }, { 0x1F191, 0x1F19A },
+    { 0x1F200, 0x1F202 }, { 0x1F210, 0x1F23B }, { 0x1F240, 0x1F248 },
+    { 0x1F250, 0x1F251 }, { 0x1F260, 0x1F265 }, { 0x1F300, 0x1F320 },
+    { 0x1F32D, 0x1F335 }, { 0x1F337, 0x1F37C }, { 0x1F37E, 0x1F393 },
+    { 0x1F3A0, 0x1F3CA }, { 0x1F3CF, 0x1F3D3 }, { 0x1F3E0, 0x1F3F0 },
+    { 0x1F3F4, 0x1F3F4 }, { 0x1F3F8, 0x1F43E }, { 0x1F440, 0x1F440 },
+    { 0x1F442, 0x1F4FC }, { 0x1F4FF, 0x1F53D }, { 0x1F54B, 0x1F54E },
+    { 0x1F550, 0x1F567 }, { 0x1F57A, 0x1F57A }, { 0x1F595, 0x1F596 },
+    { 0x1F5A4, 0x1F5A4 }, { 0x1F5FB, 0x1F64F }, { 0x1F680, 0x1F6C5 },
+    { 0x1F6CC, 0x1F6CC }, { 0x1F6D0, 0x1F6D2 }, { 0x1F6D5, 0x1F6D7 },
+    { 0x1F6EB, 0x1F6EC }, { 0x1F6F4, 0x1F6FC }, { 0x1F7E0, 0x1F7EB },
+    { 0x1F90C, 0x1F93A }, { 0x1F93C, 0x1F945 }, { 0x1F947, 0x1F9FF },
+    { 0x1FA70, 0x1FAFF }, { 0x20000, 0x2FFFD }, { 0x30000, 0x3FFFD },
+};
+
+#define N_INTERVALS(tbl) (sizeof (tbl) / sizeof ((tbl)[0]))
+
+static bool
+in_table(unsigned long ucs, const interval_t *tbl, size_t n)
+{
+    size_t lo = 0;
+    size_t hi = n;
+
+    if (ucs < tbl[0].first || ucs > tbl[n - 1].last) {
+        return (false);
+    }
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (ucs > tbl[mid].last) {
+            lo = mid + 1;
+        }
+        else if (ucs < tbl[mid].first) {
+            hi = mid;
+        }
+        else {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+/**
+ * @brief Number of columns taken by a character.
+ * @param ucs  IN  A Unicode code point, not ASCII.
+ * @return 0, 1 or 2.
+ */
+int
+ucs_width(unsigned long ucs)
+{
+    if (in_table(ucs, zero_width, N_INTERVALS(zero_width))) {
+        return (0);
+    }
+    if (in_table(ucs, double_width, N_INTERVALS(double_width))) {
+        return (2);
+    }
+    return (1);
+}
+
+/**
+ * @brief Decode one UTF-8 sequence.
+ * @param p     IN   The text;  |p[0]| is not ASCII.
+ * @param n     IN   Bytes available, at least 1.
+ * @param ucsp  OUT  The code point, or 0 if the sequence is not valid.
+ * @return Length of the sequence, or 1 if it is not valid,
+ *         including if it is cut off by the end of the text.
+ *
+ * Overlong forms and surrogates are not valid.
+ */
+size_t
+utf8_decode(const char *p, size_t n, unsigned long *ucsp)
+{
+    const unsigned char *s = (const unsigned char *)p;
+    unsigned long ucs;
+    unsigned long min;
+    size_t len;
+    size_t i;
+
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        len = 2;
+        ucs = s[0] & 0x1F;
+        min = 0x80;
+    }
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        len = 3;
+        ucs = s[0] & 0x0F;
+        min = 0x800;
+    }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        len = 4;
+        ucs = s[0] & 0x07;
+        min = 0x10000;
+    }
+    else {
+        *ucsp = 0;
+        return (1);
+    }
+
+    if (len > n) {
+        *ucsp = 0;
+        return (1);
+    }
+    for (i = 1; i < len; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *ucsp = 0;
+            return (1);
+        }
+        ucs = (ucs << 6) | (s[i] & 0x3F);
+    }
+    if (ucs < min || ucs > 0x10FFFF || (ucs >= 0xD800 && ucs <= 0xDFFF)) {
+        *ucsp = 0;
+        return (1);
+    }
+    *ucsp = ucs;
+    return (len);
+}
+
+/**
+ * @brief Number of leading bytes of |p| that are ASCII.
+ * @param p  IN  The text.
+ * @param n  IN  Its length.
+ * @return Index of the first byte with the high bit set, or |n|.
+ */
+size_t
+ascii_prefix(const char *p, size_t n)
+{
+    size_t i = 0;
+
+#ifdef HAVE_X86_SIMD
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask = _mm_movemask_epi8(v);
+
+        if (mask != 0) {
+            return (i + __builtin_ctz(mask));
+        }
+        i += 16;
+    }
+#endif
+    while (i + 8 <= n) {
+        uint64_t w;
+
+        memcpy(&w, p + i, 8);
+        if ((w & 0x8080808080808080ULL) != 0) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < n && (p[i] & 0x80) == 0) {
+        ++i;
+    }
+    return (i);
+}
+
+/**
+ * @brief Number of columns taken by a run of text.
+ * @param p  IN  The text, with no line terminators.
+ * @param n  IN  Its length.
+ * @return The display width.  It is never more than |n|.
+ *
+ * ASCII takes one column per byte, including control characters,
+ * as it always has.
+ */
+size_t
+text_width(const char *p, size_t n)
+{
+    size_t i = ascii_prefix(p, n);
+    size_t width = i;
+
+    while (i < n) {
+        unsigned long ucs;
+        size_t len;
+        size_t a;
+
+        len = utf8_decode(p + i, n - i, &ucs);
+        width += (ucs == 0) ? 1 : ucs_width(ucs);
+        i += len;
+
+        a = ascii_prefix(p + i, n - i);
+        width += a;
+        i += a;
+    }
+    return (width);
+}
+
+/*
+ * Is |p| the start of a UTF-8 sequence, cut off by the end of the text?
+ */
+static bool
+cut_off(const char *p, size_t n)
+{
+    int c = p[0] & 0xff;
+    size_t need;
+    size_t i;
+
+    need = (c >= 0xC2 && c <= 0xDF) ? 2
+         : (c >= 0xE0 && c <= 0xEF) ? 3
+         : (c >= 0xF0 && c <= 0xF4) ? 4
+         : 0;
+    if (need <= n) {
+        return (false);
+    }
+    for (i = 1; i < n; ++i) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+/**
+ * @brief The longest prefix of a run of text that fits in |cols| columns,
+ *        without splitting a character.
+ * @param p      IN   The text, with no line terminators.
+ * @param n      IN   Its length.
+ * @param cols   IN   Columns available.
+ * @param colsp  OUT  Columns taken by the prefix.
+ * @return Length of the prefix, in bytes.
+ *
+ * Characters that take no columns always fit, so combining marks stay
+ * with the character before them.  Continuation bytes at the start
+ * of |p| belong to a character cut off at the end of the text before
+ * it, so they also take no columns, and always fit.
+ */
+size_t
+text_fit(const char *p, size_t n, size_t cols, size_t *colsp)
+{
+    size_t i = 0;
+    size_t width = 0;
+
+    while (i < n && (p[i] & 0xC0) == 0x80) {
+        ++i;
+    }
+
+    while (i < n) {
+        unsigned long ucs;
+        size_t len;
+        size_t w;
+        size_t a;
+
+        a = ascii_prefix(p + i, n - i);
+        if (a > cols - width) {
+            a = cols - width;
+        }
+        width += a;
+        i += a;
+        if (i == n || (p[i] & 0x80) == 0) {
+            break;
+        }
+
+        len = utf8_decode(p + i, n - i, &ucs);
+        if (ucs == 0 && cut_off(p + i, n - i)) {
+            // The rest of it is in the next piece of text.
+            len = n - i;
+        }
+        w = (ucs == 0) ? 1 : ucs_width(ucs);
+        if (width + w > cols) {
+            break;
+        }
+        width += w;
+        i += len;
+    }
+    *colsp = width;
+    return (i);
+}
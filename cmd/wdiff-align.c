@@ -20,6 +20,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+    // Import fileno()
+
 #include <stdbool.h>
     // Import type bool
     // Import constant false
@@ -28,345 +31,1110 @@
     // Import constant EOF
     // Import type FILE
     // Import fflush()
-    // Import fgetc()
+    // Import fileno()
     // Import fprintf()
     // Import fputc()
-    // Import fputs()
+    // Import fwrite()
+    // Import snprintf()
+#include <stdlib.h>
+    // Import free()
 #include <string.h>
-    // Import strcmp()
-    // Import strncmp()
+    // Import memcpy()
+    // Import memset()
 #include <unistd.h>
+    // Import isatty()
     // Import type size_t
 
 #include <cscript.h>
+#include "wdiff-align.h"
 
-#define insert_start ((size_t)0xf001)
-#define insert_end   ((size_t)0xf002)
-#define delete_start ((size_t)0xf003)
-#define delete_end   ((size_t)0xf004)
+/*
+ * Show the spans found by the scanner, in a visible form.
+ * Used for debugging.
+ */
+int
+test_scan(int fd, const marker_dfa_t *dfa, FILE *dstf)
+{
+    scan_t scan;
+    span_t span;
+    size_t nprint = 0;
 
-struct syntax {
-    const char *str;
-    size_t     suchar;
-};
+    scan_init(&scan, fd, dfa);
+    while (scan_next(&scan, &span)) {
+        if (span.kind == span_text) {
+            fprintf(dstf, "[%.*s]", (int)span.len, span.ptr);
+        }
+        else if (span.kind == span_eol) {
+            fputc('\n', dstf);
+        }
+        else {
+            fprintf(dstf, " %x ", span.kind);
+        }
 
-typedef struct syntax syntax_t;
+        ++nprint;
+        if (nprint >= 200) {
+            fprintf(dstf, " ...\n");
+            fflush(dstf);
+            eprintf("Maxed out at %zu spans.\n", nprint);
+            scan_free(&scan);
+            return (2);
+        }
+    }
+    scan_free(&scan);
+    return (0);
+}
 
-static syntax_t syntax_tbl_std[] = {
-    { "{+", insert_start },
-    { "+}", insert_end   },
-    { "[-", delete_start },
-    { "-]", delete_end   },
-};
+#define OBUF_FLUSH (64 * 1024)
 
-static syntax_t syntax_tbl_ctrl[] = {
-    { "\x1c", insert_start },
-    { "\x1d", insert_end   },
-    { "\x1e", delete_start },
-    { "\x1f", delete_end   },
-};
+/*
+ * Colors of text on a display line.  Every display line starts
+ * and ends in the default color, so no reset is ever needed
+ * at the start of a line.  Each color change is followed by
+ * an erase to end of line, as grep does, so that a line that wraps
+ * on a terminal does not fill the rest of the row with color.
+ */
+#define color_none  0
+#define color_red   1
+#define color_green 2
+
+static const char esc_red[]   = "\e[01;31m\e[K";
+static const char esc_green[] = "\e[01;32m\e[K";
+static const char esc_reset[] = "\e[m\e[K";
+
+#define ESC_MAXLEN (sizeof (esc_red) - 1)
+
+void
+align_init(align_t *a, FILE *dstf, bool color, bool show_midline)
+{
+    a->dstf = dstf;
+    a->tty = dstf != NULL && isatty(fileno(dstf));
+    a->sink = NULL;
+    a->sink_arg = NULL;
+    a->warn = NULL;
+    a->warn_arg = NULL;
+    a->stats = NULL;
+    a->color = color;
+    a->show_midline = show_midline;
+    a->fold = 0;
+    a->fcol = 0;
+    a->bcol = 0;
+    a->fine = false;
+    a->format = format_text;
+    a->columns = false;
+    a->hold = false;
+    a->in_insert = false;
+    a->in_delete = false;
+    a->tbuf = NULL;
+    a->tlen = 0;
+    a->tsz = 0;
+    a->runv = NULL;
+    a->runc = 0;
+    a->runsz = 0;
+    char_diff_init(&a->cd);
+    a->fbuf = NULL;
+    a->fsz = 0;
+    a->frunv = NULL;
+    a->frunsz = 0;
+    a->obuf = NULL;
+    a->olen = 0;
+    a->osz = 0;
+    a->heldv = NULL;
+    a->heldc = 0;
+    a->heldsz = 0;
+}
+
+void
+align_free(align_t *a)
+{
+    free(a->tbuf);
+    free(a->runv);
+    free(a->fbuf);
+    free(a->frunv);
+    free(a->obuf);
+    free(a->heldv);
+    char_diff_free(&a->cd);
+    a->tbuf = NULL;
+    a->tsz = 0;
+    a->runv = NULL;
+    a->runsz = 0;
+    a->fbuf = NULL;
+    a->fsz = 0;
+    a->frunv = NULL;
+    a->frunsz = 0;
+    a->obuf = NULL;
+    a->osz = 0;
+}
 
 /*
- * Get a single Super-Unicode character.
+ * Grow a buffer to hold at least |need| elements.
  *
- * Super-Unicode is a fictitious character set that includes extra
- * wide characters that cannot appear in ordinary Unicode, and can
- * safely be used to represent our own super-characters, such as
- * {start of insert, end of insert, start of delete, end of delete}.
- *
- * These super-characters cannot occur in the input file.
- * They must be represented by some sequence of characters.
- *
- * Here, we translate those input sequences to super-characters,
- * so that all other program logic need not deal with multi-byte
- * sequences.
- *
- * If an input byte is the start of a multi-byte sequence, then
- * more bytes are read from the input.  If a complete multi-byte
- * sequence is matched, then the corresponding super-character
- * is returned.  Since, the syntax table can have more than one
- * mutli-byte seqence with the same prefix, bytes must be read
- * until an unambiguous match is found, or until we know that the
- * partial sequence cannot match any super-character, in which case
- * an ordinary character is returned, and the input cursor is advanced
- * by only one character.
- *
- * This is functionally equivalent to an fgrep-like finte automaton
- * that is limitied to mathing a list of fixed strings.
+ * Buffers only ever grow, and they are reused from one input line
+ * to the next, so once the longest line has been seen, there is
+ * no more allocation.
+ */
+static void *
+grow(void *buf, size_t *szp, size_t need, size_t elsz)
+{
+    size_t sz;
+
+    sz = *szp ? *szp : 1024;
+    while (sz < need) {
+        sz *= 2;
+    }
+    *szp = sz;
+    return (guard_realloc(buf, sz * elsz));
+}
+
+/**
+ * @brief Write out all batched output.
+ * @param a  IN/OUT  The renderer.
+ * @return void
+ */
+void
+align_flush(align_t *a)
+{
+    if (a->olen != 0 && a->sink != NULL) {
+        a->sink(a->sink_arg, a->obuf, a->olen);
+        a->olen = 0;
+    }
+    if (a->olen != 0 && a->dstf != NULL) {
+        if (a->stats != NULL) {
+            double t0 = stats_clock();
+
+            fwrite(a->obuf, 1, a->olen, a->dstf);
+            a->stats->t_io += stats_clock() - t0;
+            a->stats->bytes_written += a->olen;
+        }
+        else {
+            fwrite(a->obuf, 1, a->olen, a->dstf);
+        }
+        a->olen = 0;
+    }
+}
+
+/**
+ * @brief Append bytes to the output, in order with aligned lines.
+ * @param a    IN/OUT  The renderer.
+ * @param str  IN      Bytes to be written.
+ * @param len  IN      Number of bytes.
+ * @return void
+ */
+void
+align_puts(align_t *a, const char *str, size_t len)
+{
+    if (a->olen + len > a->osz) {
+        a->obuf = grow(a->obuf, &a->osz, a->olen + len, 1);
+    }
+    memcpy(a->obuf + a->olen, str, len);
+    a->olen += len;
+    if (a->olen >= OBUF_FLUSH && !a->hold) {
+        align_flush(a);
+    }
+}
+
+/*
+ * The color of a run of change class |lc| on display line |lnr|:
+ * deleted text is red on the "before" line, inserted text is green
+ * on the "after" line, and all else is in the default color,
+ * including the spaces that stand in for text from the other side.
+ */
+static inline int
+run_color(int lc, int lnr)
+{
+    if (lc == '-' && lnr == 1) {
+        return (color_red);
+    }
+    if (lc == '+' && lnr == 2) {
+        return (color_green);
+    }
+    return (color_none);
+}
+
+/*
+ * Append the escape sequence to switch from color |prev| to |color|,
+ * if they differ.  There is always room in the output buffer.
+ */
+static inline char *
+switch_color(char *op, int prev, int color)
+{
+    const char *esc;
+    size_t len;
+
+    if (color == prev) {
+        return (op);
+    }
+
+    if (color == color_red) {
+        esc = esc_red;
+        len = sizeof (esc_red) - 1;
+    }
+    else if (color == color_green) {
+        esc = esc_green;
+        len = sizeof (esc_green) - 1;
+    }
+    else {
+        esc = esc_reset;
+        len = sizeof (esc_reset) - 1;
+    }
+    memcpy(op, esc, len);
+    return (op + len);
+}
+
+/*
+ * Append one of the "before" or "after" display lines.
+ * Text that is not on this side of the change is replaced
+ * by as many spaces as it takes columns, to keep the two lines aligned.
  *
+ * With color, there is one escape sequence for each change of color,
+ * and a reset at the end only if the line ends in color.
  */
-static int
-get_su_char(FILE *srcf, syntax_t *syntax_tbl)
+static char *
+render_side(const align_t *a, char *op, int lnr, int end)
 {
-    static char ungetbuf[16];
-    static char sbuf[16];
-    static size_t spos = 0;
-    static size_t upos = 0;
-    size_t n_syntax = 4;
-    int c;
+    const char *text = a->tbuf;
+    int blank = (lnr == 1) ? '+' : '-';
+    int color = color_none;
+    size_t i;
+
+    for (i = 0; i < a->runc; ++i) {
+        const run_t *r = &a->runv[i];
 
-    while (true) {
-        size_t i;
-        bool any_pfx;
+        if (a->color) {
+            int next = run_color(r->op, lnr);
 
-        if (upos) {
-            --upos;
-            c = ungetbuf[upos] & 0xff;
+            op = switch_color(op, color, next);
+            color = next;
+        }
+        if (r->op == blank) {
+            memset(op, ' ', r->cols);
+            op += r->cols;
         }
         else {
-            c = fgetc(srcf);
+            memcpy(op, text, r->len);
+            op += r->len;
         }
+        text += r->len;
+    }
+    op = switch_color(op, color, color_none);
+    *op++ = end;
+    *op++ = '\n';
+    return (op);
+}
 
-        if (c == EOF) {
-            return (EOF);
+/*
+ * Append a run to the rebuilt line, merging it with the last run
+ * if it has the same change class.
+ */
+static size_t
+push_run(align_t *a, size_t runc, int op, const char *text, size_t len)
+{
+    memcpy(a->fbuf + a->tlen, text, len);
+    a->tlen += len;
+    if (runc != 0 && a->frunv[runc - 1].op == op) {
+        a->frunv[runc - 1].len += len;
+        return (runc);
+    }
+    a->frunv[runc].op = op;
+    a->frunv[runc].len = len;
+    return (runc + 1);
+}
+
+/*
+ * With --fine, rebuild the text and runs of a line, or of a band,
+ * so that wherever a deleted run is next to an inserted run,
+ * the characters they have in common are shown once, as unchanged,
+ * and only the characters that differ are marked.  See char_diff().
+ *
+ * The rebuilt text is never longer than the original, and it has
+ * at most one run per character.
+ */
+static void
+refine_runs(align_t *a)
+{
+    const char *text = a->tbuf;
+    size_t tlen = a->tlen;
+    size_t runc = 0;
+    char *swap_text;
+    run_t *swap_runv;
+    size_t swap_sz;
+    size_t i;
+
+    for (i = 0; i + 1 < a->runc; ++i) {
+        if (a->runv[i].op != ' ' && a->runv[i + 1].op != ' ') {
+            break;
         }
+    }
+    if (i + 1 >= a->runc) {
+        return;
+    }
 
-        sbuf[spos] = c;
-        sbuf[spos + 1] = '\0';
-        any_pfx = false;
-        for (i = 0; i < n_syntax; ++i) {
-            const char *s = syntax_tbl[i].str;
-            size_t len;
+    if (tlen > a->fsz) {
+        a->fbuf = grow(a->fbuf, &a->fsz, tlen, 1);
+    }
+    if (a->runc + tlen > a->frunsz) {
+        a->frunv = grow(a->frunv, &a->frunsz, a->runc + tlen, sizeof (run_t));
+    }
 
-            len = 0;
-            while (s[len]) {
-                ++len;
-            }
+    a->tlen = 0;
+    for (i = 0; i < a->runc; ++i) {
+        const run_t *r = &a->runv[i];
+        size_t editc = 0;
+        size_t k;
 
-            if (strcmp(sbuf, s) == 0) {
-                spos = 0;
-                return (syntax_tbl[i].suchar);
+        if (r->op != ' ' && i + 1 < a->runc && a->runv[i + 1].op != ' ') {
+            const run_t *r2 = &a->runv[i + 1];
+
+            // The deleted text is always s1, whichever comes first.
+            if (r->op == '-') {
+                editc = char_diff(&a->cd, text, r->len, text + r->len, r2->len);
+            }
+            else {
+                editc = char_diff(&a->cd, text + r->len, r2->len, text, r->len);
             }
+        }
+        if (editc == 0) {
+            runc = push_run(a, runc, r->op, text, r->len);
+            text += r->len;
+            continue;
+        }
+        for (k = 0; k < editc; ++k) {
+            const edit_t *e = &a->cd.editv[k];
 
-            any_pfx = any_pfx || (spos < len && strncmp(sbuf, s, spos + 1) == 0);
+            runc = push_run(a, runc, e->op, e->text, e->len);
         }
+        text += r->len + a->runv[i + 1].len;
+        ++i;
+    }
+
+    // The original buffers are kept, to hold the next line rebuilt.
+    swap_text = a->tbuf;
+    a->tbuf = a->fbuf;
+    a->fbuf = swap_text;
+    swap_sz = a->tsz;
+    a->tsz = a->fsz;
+    a->fsz = swap_sz;
+    swap_runv = a->runv;
+    a->runv = a->frunv;
+    a->frunv = swap_runv;
+    swap_sz = a->runsz;
+    a->runsz = a->frunsz;
+    a->frunsz = swap_sz;
+    a->runc = runc;
+}
+
+static inline char *
+put_str(char *op, const char *str)
+{
+    size_t len = strlen(str);
+
+    memcpy(op, str, len);
+    return (op + len);
+}
+
+static inline char *
+put_dec(char *op, size_t v)
+{
+    char digits[20];
+    int n = 0;
 
-        if (any_pfx) {
-            // The characters accumulated in sbuf, so far,
-            // is a prefix of at least one entry in syntax_tbl
-            // So, keep reading raw characters.
-            //
-            ++spos;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n != 0) {
+        *op++ = digits[--n];
+    }
+    return (op);
+}
+
+/*
+ * An unsigned LEB128 number:  7 bits a byte, low bits first,
+ * with the high bit set on all but the last byte.
+ */
+static inline char *
+put_varint(char *op, size_t v)
+{
+    while (v >= 0x80) {
+        *op++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *op++ = v;
+    return (op);
+}
+
+/*
+ * Append the text of one side of the change, the "before" text
+ * (|skip| is '+') or the "after" text (|skip| is '-'),
+ * as a JSON string.  A byte XX that is not valid UTF-8 is written
+ * as the lone surrogate \udcXX, as by the "surrogateescape" error
+ * handler of Python.  No valid UTF-8 decodes to a surrogate,
+ * so the bytes can be had back exactly, and the byte offsets
+ * of the runs hold for them.
+ */
+static char *
+put_json_side(const align_t *a, char *op, int skip)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *text = a->tbuf;
+    size_t i;
+
+    *op++ = '"';
+    for (i = 0; i < a->runc; ++i) {
+        const run_t *r = &a->runv[i];
+        size_t pos = 0;
+
+        if (r->op == skip) {
+            text += r->len;
             continue;
         }
+        while (pos < r->len) {
+            unsigned char c = text[pos];
+            unsigned long ucs;
+            size_t n;
+
+            if (c == '"' || c == '\\') {
+                *op++ = '\\';
+                *op++ = c;
+                ++pos;
+            }
+            else if (c == '\t') {
+                *op++ = '\\';
+                *op++ = 't';
+                ++pos;
+            }
+            else if (c < 0x20 || c == 0x7f) {
+                op = put_str(op, "\\u00");
+                *op++ = hex[c >> 4];
+                *op++ = hex[c & 0xf];
+                ++pos;
+            }
+            else if (c < 0x80) {
+                *op++ = c;
+                ++pos;
+            }
+            else {
+                n = utf8_decode(text + pos, r->len - pos, &ucs);
+                if (ucs == 0) {
+                    op = put_str(op, "\\udc");
+                    *op++ = hex[c >> 4];
+                    *op++ = hex[c & 0xf];
+                    n = 1;
+                }
+                else {
+                    memcpy(op, text + pos, n);
+                    op += n;
+                }
+                pos += n;
+            }
+        }
+        text += r->len;
+    }
+    *op++ = '"';
+    return (op);
+}
+
+/*
+ * Instead of display lines, write one record for the line:
+ * the "before" and "after" text, and the list of runs, each with
+ * its change class, its offset in the "before" text and in the
+ * "after" text, and its length, in bytes.  With |columns|,
+ * each run also has its column and width in the aligned display.
+ * An inserted run has the offset in the "before" text where it would
+ * go, and a deleted run likewise in the "after" text.
+ *
+ * As JSON, a record is one line:
+ *
+ *   {"before":"...","after":"...","runs":[[" ",0,0,4],["-",4,4,3],...]}
+ *
+ * In binary, it is a byte, 'e', or 'E' if there are columns,
+ * then the length of the "before" text, the length of the "after" text,
+ * and the number of runs, then the two texts, then for each run,
+ * its change class as a byte, ' ', '-' or '+', then its offsets,
+ * length, and maybe column and width.  All numbers are unsigned LEB128.
+ *
+ * There is no padding, and nothing to parse back out of it.
+ */
+static void
+render_record(align_t *a)
+{
+    const char *text = a->tbuf;
+    size_t boff = 0;
+    size_t aoff = 0;
+    size_t col = 0;
+    size_t need;
+    char *op;
+    size_t i;
 
-        // sbuf is not a prefix of any members of syntax_tbl
-        //
+    if (a->format == format_jsonl) {
+        // Any byte of text may become \u00XX or \udcXX, on both sides.
+        need = 12 * a->tlen + a->runc * (8 + 5 * 20) + 64;
+    }
+    else {
+        need = 2 * a->tlen + a->runc * (1 + 5 * 10) + 1 + 3 * 10;
+    }
+    if (a->olen + need > a->osz) {
+        a->obuf = grow(a->obuf, &a->osz, a->olen + need, 1);
+    }
+    op = a->obuf + a->olen;
 
-        if (spos) {
-            // If we have accumulated any characters (not including c)
-            // then put them back to be read the next time.
-            //
-            size_t pos;
+    if (a->format == format_jsonl) {
+        op = put_str(op, "{\"before\":");
+        op = put_json_side(a, op, '+');
+        op = put_str(op, ",\"after\":");
+        op = put_json_side(a, op, '-');
+        op = put_str(op, ",\"runs\":[");
+        for (i = 0; i < a->runc; ++i) {
+            const run_t *r = &a->runv[i];
 
-            for (pos = spos; pos != 0; --pos) {
-                ungetbuf[upos++] = sbuf[pos];
+            if (i != 0) {
+                *op++ = ',';
             }
-            spos = 0;
+            *op++ = '[';
+            *op++ = '"';
+            *op++ = r->op;
+            *op++ = '"';
+            *op++ = ',';
+            op = put_dec(op, boff);
+            *op++ = ',';
+            op = put_dec(op, aoff);
+            *op++ = ',';
+            op = put_dec(op, r->len);
+            if (a->columns) {
+                *op++ = ',';
+                op = put_dec(op, col);
+                *op++ = ',';
+                op = put_dec(op, r->cols);
+            }
+            *op++ = ']';
+            boff += r->op != '+' ? r->len : 0;
+            aoff += r->op != '-' ? r->len : 0;
+            col += r->cols;
+        }
+        op = put_str(op, "]}\n");
+        a->olen = op - a->obuf;
+        return;
+    }
 
-            ungetbuf[upos] = '\0';
-            c = sbuf[0];
-            dbg_printf("putback: sbuf=[%s], ungetbuf=[%s], c=%c\n",
-                       sbuf, ungetbuf, c);
+    for (i = 0; i < a->runc; ++i) {
+        boff += a->runv[i].op != '+' ? a->runv[i].len : 0;
+        aoff += a->runv[i].op != '-' ? a->runv[i].len : 0;
+    }
+    *op++ = a->columns ? 'E' : 'e';
+    op = put_varint(op, boff);
+    op = put_varint(op, aoff);
+    op = put_varint(op, a->runc);
+    for (i = 0; i < a->runc; ++i) {
+        if (a->runv[i].op != '+') {
+            memcpy(op, text, a->runv[i].len);
+            op += a->runv[i].len;
+        }
+        text += a->runv[i].len;
+    }
+    text = a->tbuf;
+    for (i = 0; i < a->runc; ++i) {
+        if (a->runv[i].op != '-') {
+            memcpy(op, text, a->runv[i].len);
+            op += a->runv[i].len;
         }
+        text += a->runv[i].len;
+    }
+
+    boff = 0;
+    aoff = 0;
+    for (i = 0; i < a->runc; ++i) {
+        const run_t *r = &a->runv[i];
 
-        return (c);
+        *op++ = r->op;
+        op = put_varint(op, boff);
+        op = put_varint(op, aoff);
+        op = put_varint(op, r->len);
+        if (a->columns) {
+            op = put_varint(op, col);
+            op = put_varint(op, r->cols);
+        }
+        boff += r->op != '+' ? r->len : 0;
+        aoff += r->op != '-' ? r->len : 0;
+        col += r->cols;
     }
+    a->olen = op - a->obuf;
 }
 
-int
-test_get_su_char(FILE *srcf, FILE *dstf)
+/*
+ * Build all three display lines of a line, or of a band:
+ * 1) before; 2) middle; 3) after, in the output buffer,
+ * a whole run at a time.  Each display line ends with |end|.
+ */
+static void
+render_lines(align_t *a, int end)
 {
-    size_t nprint = 0;
+    size_t need;
+    char *op;
+    size_t i;
 
-    while (true) {
-        int c;
+    need = 3 * (a->tlen + 2);
+    if (a->color) {
+        need += 2 * (a->runc + 1) * ESC_MAXLEN;
+    }
+    if (a->olen + need > a->osz) {
+        a->obuf = grow(a->obuf, &a->osz, a->olen + need, 1);
+    }
+    op = a->obuf + a->olen;
 
-        c = get_su_char(srcf, &syntax_tbl_std[0]);
-        if (c == EOF) {
-            return (0);
-        }
-        if (c >= 0x20 && c <= 0x7e) {
-            fputc(c, dstf);
+    /*
+     * Show line 1 -- before changes
+     */
+    op = render_side(a, op, 1, end);
+
+    /*
+     * Maybe show middle line, which marks insertions and deletions +/-
+     */
+    if (a->show_midline) {
+        for (i = 0; i < a->runc; ++i) {
+            memset(op, a->runv[i].op, a->runv[i].cols);
+            op += a->runv[i].cols;
         }
-        else if (c == '\r' || c == '\n') {
-            fputc(c, dstf);
+        *op++ = end;
+        *op++ = '\n';
+    }
+
+    /*
+     * Show line 2 -- after changes
+     */
+    op = render_side(a, op, 2, end);
+
+    a->olen = op - a->obuf;
+}
+
+/*
+ * The text of a line, or of a band of a folded line, and its runs
+ * of unchanged, deleted and inserted characters are known.
+ * Show them, as display lines, or as a record.
+ *
+ * The display width of each run is found first, checking the whole
+ * band at once for the common case of ASCII.  A run never takes
+ * more columns than it has bytes, so padding never takes more room
+ * than the text it stands in for.  A record without columns
+ * needs no widths.
+ */
+static void
+render_band(align_t *a, int end)
+{
+    const char *text = a->tbuf;
+    size_t i;
+    double t0 = 0;
+
+    if (a->stats != NULL) {
+        t0 = stats_clock();
+    }
+
+    if (a->fine) {
+        refine_runs(a);
+        text = a->tbuf;
+    }
+
+    if (a->format != format_text && !a->columns) {
+        // Widths are not needed.
+        a->fcol += a->tlen;
+    }
+    else if (ascii_prefix(text, a->tlen) == a->tlen) {
+        // The common case:  one column per byte.
+        for (i = 0; i < a->runc; ++i) {
+            a->runv[i].cols = a->runv[i].len;
         }
-        else {
-            fprintf(dstf, " %x ", c);
+        a->fcol += a->tlen;
+    }
+    else {
+        for (i = 0; i < a->runc; ++i) {
+            run_t *r = &a->runv[i];
+
+            r->cols = text_width(text, r->len);
+            text += r->len;
+            a->fcol += r->cols;
         }
+    }
 
-        ++nprint;
-        if (nprint >= 200) {
-            fprintf(dstf, " ...\n");
-            fflush(dstf);
-            eprintf("Maxed out at %zu characters.\n", nprint);
-            return (2);
+    if (a->format != format_text) {
+        render_record(a);
+    }
+    else {
+        render_lines(a, end);
+    }
+
+    a->tlen = 0;
+    a->runc = 0;
+    a->bcol = 0;
+
+    if (a->stats != NULL) {
+        a->stats->t_render += stats_clock() - t0;
+    }
+
+    // On a terminal, each band is shown as soon as it is done.
+    if (a->hold) {
+        return;
+    }
+    if (a->tty && a->dstf != NULL) {
+        align_flush(a);
+        fflush(a->dstf);
+    }
+    else if (a->olen >= OBUF_FLUSH) {
+        align_flush(a);
+    }
+}
+
+/*
+ * End of an input line.  Show it, or the last band of it,
+ * if it is folded.
+ */
+void
+align_eol(align_t *a)
+{
+    render_band(a, '|');
+
+    if (a->stats != NULL) {
+        ++a->stats->records;
+        a->stats->width_sum += a->fcol;
+        if (a->fcol > a->stats->width_max) {
+            a->stats->width_max = a->fcol;
         }
     }
+    a->fcol = 0;
 }
 
+/*
+ * Flush a partial last line, one that is not terminated by a newline,
+ * and all batched output.
+ */
 void
-switch_color(FILE *dstf, int prev_lc, int lc, int lnr)
+align_finish(align_t *a)
 {
-    if (lc == prev_lc) {
-        return;
+    if (a->tlen != 0 || a->fcol != 0) {
+        align_eol(a);
     }
+    align_flush(a);
+}
 
-    if (lc == '-' && lnr == 1) {
-        fputs("\e[01;31m\e[K", dstf);
+static void
+warn_both(align_t *a, const char *cancel)
+{
+    // Keep the warning in order with the aligned lines.
+    align_flush(a);
+    if (a->stats != NULL) {
+        ++a->stats->warnings;
+    }
+    if (a->warn != NULL) {
+        char msg[100];
+
+        snprintf(msg, sizeof (msg),
+            "not allowed to be inserting and deleting at the same time;"
+            " canceling %s", cancel);
+        a->warn(a->warn_arg, msg);
+        return;
     }
-    else if (lc == '+' && lnr == 2) {
-        fputs("\e[01;32m\e[K", dstf);
+    if (a->dstf == NULL && a->sink == NULL) {
+        // Output is kept for the caller;  so is the warning.
+        if (a->heldc == a->heldsz) {
+            a->heldsz = a->heldsz ? 2 * a->heldsz : 16;
+            a->heldv = guard_realloc(a->heldv, a->heldsz * sizeof (held_warning_t));
+        }
+        a->heldv[a->heldc].off = a->olen;
+        a->heldv[a->heldc].cancel = cancel;
+        ++a->heldc;
+        return;
     }
-    else {
-        fputs("\e[m\e[K", dstf);
+    if (a->dstf != NULL) {
+        fflush(a->dstf);
     }
+    align_print_warning(cancel);
 }
 
+/**
+ * @brief Write the warning about inserting and deleting at the same time.
+ * @param cancel  IN  What is canceled:  "insert" or "delete".
+ * @return void
+ */
 void
-wdiff_align(FILE *srcf, FILE *dstf, bool ctrl, bool color, bool show_midline)
+align_print_warning(const char *cancel)
 {
-    static char l1buf[1024];
-    static char l2buf[1024];
-    static char lcbuf[1024];
-    size_t pos;
-    int c;
-    bool in_insert = false;
-    bool in_delete = false;
-    syntax_t *syntax_tbl;
-
-    syntax_tbl = ctrl ? syntax_tbl_ctrl : syntax_tbl_std;
-
-    pos = 0;
-    while (true) {
-        c = get_su_char(srcf, syntax_tbl);
-        if (c == '\r' || c == '\n' || (c == EOF && pos != 0)) {
-            /*
-             * At the end of an input line, three display lines have been
-             * computed:  1) before; 2) middle; 3) after.
-             */
-            size_t len = pos;
-            int prev_lc;
-            l1buf[pos] = '\0';
-            l2buf[pos] = '\0';
-            lcbuf[pos] = '\0';
-
-            /*
-             * Show line 1 -- before changes
-             */
-            prev_lc = 0;
-            for (pos = 0; pos < len; ++pos) {
-                if (color) {
-                    switch_color(dstf, prev_lc, lcbuf[pos], 1);
-                }
-                fputc(l1buf[pos], dstf);
-                prev_lc = lcbuf[pos];
-            }
-            fputc('|', dstf);
-            fputc('\n', dstf);
+    eprintf("WARNING:"
+        " not allowed to be inserting and deleting"
+        " at the same time.\n");
+    eprintf("Canceling %s.\n", cancel);
+}
 
-            /*
-             * Maybe show middle line, which marks insertions and deletions +/-
-             */
-            if (show_midline) {
-                fputs(lcbuf, dstf);
-                fputc('|', dstf);
-                fputc('\n', dstf);
-            }
+/**
+ * @brief The insert/delete state after a marker.
+ * @param state   IN  One of state_plain, state_insert, state_delete.
+ * @param suchar  IN  A marker super-character.
+ * @return The new state.
+ *
+ * This is the state change made by align_marker(), without the warnings.
+ */
+int
+marker_state(int state, int suchar)
+{
+    switch (suchar) {
+    case insert_start:
+        return (state_insert);
+    case insert_end:
+        return (state == state_insert ? state_plain : state);
+    case delete_start:
+        return (state_delete);
+    case delete_end:
+        return (state == state_delete ? state_plain : state);
+    }
+    return (state);
+}
 
-            /*
-             * Show line 2 -- after changes
-             */
-            prev_lc = 0;
-            for (pos = 0; pos < len; ++pos) {
-                if (color) {
-                    switch_color(dstf, prev_lc, lcbuf[pos], 2);
-                }
-                fputc(l2buf[pos], dstf);
-                prev_lc = lcbuf[pos];
-            }
-            fputc('|', dstf);
-            fputc('\n', dstf);
+/*
+ * Manage switching between insert, delete (or stating the same)
+ */
+void
+align_marker(align_t *a, int c)
+{
+    if (a->stats != NULL) {
+        ++a->stats->markers[c - insert_start];
+    }
 
-            if (color) {
-                fputs("\e[m\e[K", dstf);
-            }
-            pos = 0;
+    switch (c) {
+    case insert_start:
+        a->in_insert = true;
+        if (a->in_delete) {
+            warn_both(a, "delete");
+            a->in_delete = false;
+        }
+        break;
+    case insert_end:
+        a->in_insert = false;
+        break;
+    case delete_start:
+        a->in_delete = true;
+        if (a->in_insert) {
+            warn_both(a, "insert");
+            a->in_insert = false;
+        }
+        break;
+    case delete_end:
+        a->in_delete = false;
+        break;
+    }
+}
 
-            if (c == EOF) {
-                break;
-            }
+/*
+ * Append a run of text, with no line terminators, to the current line.
+ * Consecutive text with the same change class -- unchanged, inserted
+ * or deleted -- is kept as a single run.
+ */
+static void
+align_run1(align_t *a, const char *text, size_t len)
+{
+    int op;
+
+    if (a->tlen + len > a->tsz) {
+        a->tbuf = grow(a->tbuf, &a->tsz, a->tlen + len, 1);
+    }
+    memcpy(a->tbuf + a->tlen, text, len);
+    a->tlen += len;
+
+    op = a->in_insert ? '+' : a->in_delete ? '-' : ' ';
+    if (a->runc != 0 && a->runv[a->runc - 1].op == op) {
+        a->runv[a->runc - 1].len += len;
+        return;
+    }
+    if (a->runc == a->runsz) {
+        a->runv = grow(a->runv, &a->runsz, a->runc + 1, sizeof (run_t));
+    }
+    a->runv[a->runc].op = op;
+    a->runv[a->runc].len = len;
+    ++a->runc;
+}
+
+/*
+ * With --fold, a line is shown in bands of |fold| columns.  A band
+ * is shown as soon as it is full and there is more of the line to
+ * come, so only one band is ever kept, however long the line is.
+ * All but the last band of a line end with '\' instead of '|'.
+ * A character is never split between bands;  one that is too wide
+ * to fit ends the band early.
+ */
+static void
+align_run(align_t *a, const char *text, size_t len)
+{
+    if (a->fold == 0) {
+        align_run1(a, text, len);
+        return;
+    }
+
+    while (len != 0) {
+        size_t cols;
+        size_t n;
+
+        n = text_fit(text, len, a->fold - a->bcol, &cols);
+        if (n == 0 && a->tlen != 0) {
+            render_band(a, '\\');
             continue;
         }
+        if (n == 0) {
+            // A band of 1 column, and a wide character
+            n = text_fit(text, len, 2, &cols);
+        }
+        align_run1(a, text, n);
+        a->bcol += cols;
+        text += n;
+        len -= n;
+    }
+}
+
+/*
+ * Append text to the current line.
+ * A carriage return or newline ends the current input line.
+ */
+void
+align_text(align_t *a, const char *text, size_t len)
+{
+    const char *end = text + len;
+
+    while (text < end) {
+        const char *eol = text;
 
-        if (c == EOF) {
+        while (eol < end && *eol != '\r' && *eol != '\n') {
+            ++eol;
+        }
+        if (eol > text) {
+            align_run(a, text, eol - text);
+        }
+        if (eol == end) {
             break;
         }
+        align_eol(a);
+        text = eol + 1;
+    }
+}
 
-        /*
-         * Manage switching between insert, delete (or stating the same)
-         */
-        switch (c) {
-        case insert_start:
-            in_insert = true;
-            if (in_delete) {
-                eprintf("WARNING:"
-                    " not allowed to be inserting and deleting"
-                    " at the same time.\n");
-                eprintf("Canceling delete.\n");
-                in_delete = false;
-            }
-            break;
-        case insert_end:
-            in_insert = false;
+/**
+ * @brief Feed the spans from a scanner to the renderer,
+ *        for as long as the scanner has any.
+ * @param a   IN/OUT  The renderer.
+ * @param sc  IN/OUT  The scanner.
+ * @return void
+ *
+ * Unlike align_scan(), this does not finish the last line,
+ * so that more input can be pushed to the scanner later.
+ */
+void
+align_spans(align_t *a, scan_t *sc)
+{
+    span_t span;
+
+    while (scan_next(sc, &span)) {
+        switch (span.kind) {
+        case span_text:
+            align_text(a, span.ptr, span.len);
             break;
-        case delete_start:
-            in_delete = true;
-            if (in_insert) {
-                eprintf("WARNING:"
-                    " not allowed to be inserting and deleting"
-                    " at the same time.\n");
-                eprintf("Canceling insert.\n");
-                in_insert = false;
-            }
+        case span_eol:
+            align_eol(a);
             break;
-        case delete_end:
-            in_delete = false;
+        default:
+            align_marker(a, span.kind);
             break;
         }
+    }
+}
 
-        /*
-         * Set the current character in all three display lines,
-         * depending on whether we are inserting, deleting, or no change
-         * in this character position.
-         *
-         * Compute all three display lines, even if we will not be showing
-         * the middle line.
-         */
-        switch (c) {
-        case insert_start:
-        case insert_end:
-        case delete_start:
-        case delete_end:
-            break;
-        default:
-            if (in_insert) {
-                l1buf[pos] = ' ';
-                l2buf[pos] = c;
-                lcbuf[pos] = '+';
-            }
-            else if (in_delete) {
-                l1buf[pos] = c;
-                l2buf[pos] = ' ';
-                lcbuf[pos] = '-';
-            }
-            else {
-                l1buf[pos] = c;
-                l2buf[pos] = c;
-                lcbuf[pos] = ' ';
-            }
-            ++pos;
+/**
+ * @brief Feed all the spans from a scanner to the renderer.
+ * @param a   IN/OUT  The renderer.
+ * @param sc  IN/OUT  The scanner.
+ * @return 0, or the errno value from a failed read.
+ *
+ * The scanner counts into the same statistics as the renderer, if any.
+ */
+int
+align_scan(align_t *a, scan_t *sc)
+{
+    double t0 = 0;
+    double prev = 0;
+
+    sc->stats = a->stats;
+    if (a->stats != NULL) {
+        t0 = stats_clock();
+        prev = a->stats->t_render + a->stats->t_io;
+        if (!sc->own) {
+            // Nothing is read;  the whole input is already in memory.
+            a->stats->bytes_read += sc->end;
         }
     }
+
+    align_spans(a, sc);
+    align_finish(a);
+    if (a->stats != NULL) {
+        stats_add_parse(a->stats, t0, prev);
+    }
+    return (sc->err);
+}
+
+/**
+ * @brief Read the output of wdiff and show it as aligned lines.
+ * @param srcf          IN  Output of wdiff.
+ * @param dstf          IN  Write aligned lines here.
+ * @param dfa           IN  The compiled markers.
+ * @param color         IN  Color deletions red and insertions green.
+ * @param show_midline  IN  Show the middle line of +/- markers.
+ * @return 0 on success, else the errno value from a failed read.
+ *
+ * Input is read directly from the underlying file descriptor,
+ * in large blocks, so nothing must have been read from |srcf|
+ * through stdio.
+ */
+int
+wdiff_align(FILE *srcf, FILE *dstf, const marker_dfa_t *dfa, bool color, bool show_midline)
+{
+    align_t align;
+    scan_t scan;
+    int err;
+
+    scan_init(&scan, fileno(srcf), dfa);
+    align_init(&align, dstf, color, show_midline);
+    err = align_scan(&align, &scan);
+    align_free(&align);
+    scan_free(&scan);
+    return (err);
+}
+
+/**
+ * @brief Same as wdiff_align(), but for a named file.
+ * @param fname    IN  File name, or "-" for stdin.
+ * @param fold     IN  Fold lines into bands this wide, unless 0.
+ * @param fine     IN  Diff changed word pairs character by character.
+ * @param format   IN  Write display lines, or records of runs.
+ * @param columns  IN  With records, give each run its display column.
+ * @param stats    IN/OUT  Count what is seen here, unless NULL.
+ * @return 0 on success, else an errno value.
+ *
+ * A regular file is memory-mapped and parsed in place.
+ */
+int
+wdiff_align_file(const char *fname, FILE *dstf, const marker_dfa_t *dfa, bool color, bool show_midline,
+                 size_t fold, bool fine, int format, bool columns, stats_t *stats)
+{
+    input_t in;
+    align_t align;
+    scan_t scan;
+    int err;
+
+    err = input_open(&in, fname);
+    if (err) {
+        return (err);
+    }
+    scan_init_input(&scan, &in, dfa);
+    align_init(&align, dstf, color, show_midline);
+    align.fold = fold;
+    align.fine = fine;
+    align.format = format;
+    align.columns = columns;
+    align.stats = stats;
+    err = align_scan(&align, &scan);
+    align_free(&align);
+    scan_free(&scan);
+    input_close(&in);
+    return (err);
 }
@@ -0,0 +1,618 @@
+/*
+ * Filename: src/cmd/wdiff-align.h
+ * Project: wdiff-align
+ * Brief: Declarations shared by the wdiff-align modules
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WDIFF_ALIGN_H
+#define _WDIFF_ALIGN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Super-characters for start/end of insert/delete.
+// See get_su_char().
+
+#define insert_start ((size_t)0xf001)
+#define insert_end   ((size_t)0xf002)
+#define delete_start ((size_t)0xf003)
+#define delete_end   ((size_t)0xf004)
+
+// ==================== Statistics
+
+// Start insert, end insert, start delete, end delete
+
+#define N_MARKERS 4
+
+/*
+ * What was seen during a run, for --stats.
+ * Markers are counted by type, in the order above.
+ * Line width is the width of the aligned before/after lines.
+ * Times are in seconds.  See stats.c.
+ */
+struct stats {
+    size_t bytes_read;
+    size_t bytes_written;
+    size_t records;
+    size_t markers[N_MARKERS];
+    size_t width_max;
+    size_t width_sum;
+    size_t warnings;
+    double t_parse;
+    double t_render;
+    double t_io;
+};
+
+typedef struct stats stats_t;
+
+extern void   stats_init(stats_t *st);
+extern double stats_clock(void);
+extern void   stats_merge(stats_t *dst, const stats_t *src);
+extern void   stats_add_parse(stats_t *st, double t0, double prev);
+extern void   stats_print(FILE *f, const stats_t *st, double t_wall);
+extern void   stats_print_json(FILE *f, const stats_t *st, double t_wall);
+
+// ==================== Character diff of a changed word pair
+
+// Texts longer than this many characters are not diffed character by character.
+
+#define FINE_MAX 256
+
+/*
+ * One element of an edit script.
+ * |op| is the same character used in the middle display line:
+ *   ' '  unchanged
+ *   '-'  deleted
+ *   '+'  inserted
+ */
+struct edit {
+    int        op;
+    const char *text;
+    size_t     len;
+};
+
+typedef struct edit edit_t;
+
+/*
+ * Working storage for char_diff().  All arrays grow as needed,
+ * and are reused from one call to the next.  See char-diff.c.
+ */
+struct char_diff {
+    unsigned long *chv[2];
+    size_t        chsz[2];
+    size_t        *offv[2];
+    size_t        offsz[2];
+    unsigned long *symv;
+    size_t        symsz;
+    size_t        nsym;
+    size_t        *hashv;
+    size_t        hashsz;
+    size_t        hmask;
+    uint64_t      *peqv;
+    size_t        peqsz;
+    uint64_t      *colv;
+    size_t        colsz;
+    edit_t        *editv;
+    size_t        editc;
+    size_t        editsz;
+};
+
+typedef struct char_diff char_diff_t;
+
+extern void   char_diff_init(char_diff_t *cd);
+extern void   char_diff_free(char_diff_t *cd);
+extern size_t char_diff(char_diff_t *cd, const char *s1, size_t len1, const char *s2, size_t len2);
+
+// ==================== Three-line renderer
+
+/*
+ * A run of characters with the same change class:
+ *   ' '  unchanged
+ *   '-'  deleted
+ *   '+'  inserted
+ * |len| is in bytes;  |cols| is the display width, found when
+ * the run is rendered.
+ */
+struct run {
+    int    op;
+    size_t len;
+    size_t cols;
+};
+
+typedef struct run run_t;
+
+/*
+ * State of the renderer for one stream of wdiff-like events.
+ * Events are plain text, start/end of insert/delete, and end of line.
+ * Each input line becomes three display lines: before, middle, after.
+ *
+ * The text of the current line is kept once, along with its runs.
+ * Display lines are built a run at a time, in an output buffer
+ * that is written out in large batches.  All buffers are counted,
+ * not NUL-terminated, and grow to fit the longest line.
+ *
+ * Output goes to |sink|, if it is set, else to |dstf|.
+ * If both are NULL, nothing is written;  all output is kept
+ * in |obuf|, for the caller to take.  Output is batched in |obuf|,
+ * except that, if |tty| is set, as it is when |dstf| is a terminal,
+ * each line, or band of a folded line, is written as it is done.
+ *
+ * Warnings go to |warn|, if it is set, else to stderr.
+ * But if output is kept in |obuf|, and there is no |warn|, warnings
+ * are kept in |heldv|, each with its place in |obuf|, for the caller
+ * to write out along with the output, with align_print_warning().
+ *
+ * While |hold| is set, full output is not written out, so that
+ * the caller can take what was just rendered from |obuf|.
+ *
+ * If |fold| is not 0, each line is shown in bands of at most |fold|
+ * columns, as soon as each band is full;  |fcol| is the number of
+ * columns of the current line already shown in earlier bands,
+ * and |bcol| is the number of columns in the current band.
+ *
+ * If |fine| is set, a deleted run next to an inserted run is diffed
+ * character by character, with |cd|, when the line is rendered,
+ * and the text and runs of the line are rebuilt in |fbuf| and |frunv|.
+ *
+ * If |format| is not format_text, each line is written as a record
+ * of its text and runs, as a line of JSON or in binary, instead of
+ * as aligned display lines.  With |columns|, each run also gets
+ * its column and width in the aligned display.
+ *
+ * If |stats| is not NULL, what is seen is counted there.
+ */
+typedef void (*align_sink_fn)(void *arg, const char *buf, size_t len);
+typedef void (*align_warn_fn)(void *arg, const char *msg);
+
+struct held_warning {
+    size_t     off;
+    const char *cancel;
+};
+
+typedef struct held_warning held_warning_t;
+
+struct align {
+    FILE          *dstf;
+    bool          tty;
+    align_sink_fn sink;
+    void          *sink_arg;
+    align_warn_fn warn;
+    void          *warn_arg;
+    stats_t       *stats;
+    bool          color;
+    bool          show_midline;
+    size_t        fold;
+    size_t        fcol;
+    size_t        bcol;
+    bool          fine;
+    int           format;
+    bool          columns;
+    bool          hold;
+    bool          in_insert;
+    bool          in_delete;
+    char          *tbuf;
+    size_t        tlen;
+    size_t        tsz;
+    run_t         *runv;
+    size_t        runc;
+    size_t        runsz;
+    char_diff_t   cd;
+    char          *fbuf;
+    size_t        fsz;
+    run_t         *frunv;
+    size_t        frunsz;
+    char          *obuf;
+    size_t        olen;
+    size_t        osz;
+    held_warning_t *heldv;
+    size_t        heldc;
+    size_t        heldsz;
+};
+
+typedef struct align align_t;
+
+// Output formats.  See render_record().
+
+#define format_text  0
+#define format_jsonl 1
+#define format_edits 2
+
+// Insert/delete state carried from one line to the next.  See marker_state().
+
+#define state_plain  0
+#define state_insert 1
+#define state_delete 2
+#define N_STATES     3
+
+extern void align_init(align_t *a, FILE *dstf, bool color, bool show_midline);
+extern void align_free(align_t *a);
+extern void align_text(align_t *a, const char *text, size_t len);
+extern void align_marker(align_t *a, int suchar);
+extern void align_eol(align_t *a);
+extern void align_finish(align_t *a);
+extern void align_flush(align_t *a);
+extern void align_puts(align_t *a, const char *str, size_t len);
+extern void align_print_warning(const char *cancel);
+extern int  marker_state(int state, int suchar);
+
+// ==================== Display width
+
+extern size_t ascii_prefix(const char *p, size_t n);
+extern size_t utf8_decode(const char *p, size_t n, unsigned long *ucsp);
+extern int    ucs_width(unsigned long ucs);
+extern size_t text_width(const char *p, size_t n);
+extern size_t text_fit(const char *p, size_t n, size_t cols, size_t *colsp);
+
+// ==================== Markers
+
+struct syntax {
+    const char *str;
+    size_t     suchar;
+};
+
+typedef struct syntax syntax_t;
+
+// SIMD levels for skipping plain text.  See skip_select().
+
+#define simd_auto   0
+#define simd_scalar 1
+#define simd_sse2   2
+#define simd_avx2   3
+
+// Most stop bytes that can be checked with SIMD compares
+
+#define MAX_STOP_BYTES 8
+
+/*
+ * Markers compiled into a trie, with a full transition table
+ * at every state.  State 0 is the root;  -1 is the dead state.
+ *
+ * The stop bytes are the bytes that end a run of plain text:
+ * line terminators, and the first byte of each marker.
+ * Each one is also kept repeated 32 times, ready to be loaded
+ * into a vector register.
+ */
+struct marker_dfa {
+    int           *delta;
+    int           *accept;
+    size_t        nstates;
+    size_t        maxlen;
+    int           direct[256];
+    bool          special[256];
+    size_t        nstop;
+    unsigned char stopv[MAX_STOP_BYTES][32];
+    size_t        (*skip)(const struct marker_dfa *, const char *, size_t);
+};
+
+typedef struct marker_dfa marker_dfa_t;
+
+extern void        syntax_default(syntax_t *tbl, bool ctrl);
+extern const char *syntax_check(const syntax_t *tbl, size_t n);
+extern void        marker_dfa_compile(marker_dfa_t *dfa, const syntax_t *tbl, size_t n);
+extern void        marker_dfa_free(marker_dfa_t *dfa);
+extern int         marker_dfa_match(const marker_dfa_t *dfa, const char *p, size_t n, size_t *lenp);
+extern int         skip_select(marker_dfa_t *dfa, int level);
+extern int         simd_level_by_name(const char *name);
+extern const char *simd_level_name(int level);
+
+extern int  wdiff_align(FILE *srcf, FILE *dstf, const marker_dfa_t *dfa, bool color, bool show_midline);
+extern int  wdiff_align_file(const char *fname, FILE *dstf, const marker_dfa_t *dfa, bool color, bool show_midline,
+                             size_t fold, bool fine, int format, bool columns, stats_t *stats);
+extern int  wdiff_align_parallel(int filec, char **filev, FILE *dstf, const marker_dfa_t *dfa,
+                                 bool color, bool show_midline, size_t fold, bool fine,
+                                 int format, bool columns, size_t njobs, stats_t *stats);
+extern int  wdiff_align_serve(const char *path, size_t nthreads);
+
+// ==================== Input files
+
+/*
+ * An input file, either memory-mapped (map != NULL),
+ * or to be read from |fd|.
+ */
+struct input {
+    const char *fname;
+    int        fd;
+    void       *map;
+    size_t     maplen;
+};
+
+typedef struct input input_t;
+
+extern int  input_open(input_t *in, const char *fname);
+extern void input_close(input_t *in);
+
+// ==================== Block reader and span tokenizer
+
+// Kinds of span, other than the marker super-characters
+
+#define span_text ((int)0)
+#define span_eol  ((int)'\n')
+
+struct span {
+    int        kind;
+    const char *ptr;
+    size_t     len;
+};
+
+typedef struct span span_t;
+
+struct scan {
+    int                fd;
+    bool               own;
+    char               *buf;
+    size_t             bufsz;
+    size_t             pos;
+    size_t             end;
+    bool               eof;
+    int                err;
+    const marker_dfa_t *dfa;
+    stats_t            *stats;
+};
+
+typedef struct scan scan_t;
+
+extern void scan_init(scan_t *sc, int fd, const marker_dfa_t *dfa);
+extern void scan_init_mem(scan_t *sc, const char *buf, size_t len, const marker_dfa_t *dfa);
+extern void scan_init_input(scan_t *sc, const input_t *in, const marker_dfa_t *dfa);
+extern void scan_init_push(scan_t *sc, const marker_dfa_t *dfa);
+extern void scan_push(scan_t *sc, const char *buf, size_t len);
+extern void scan_push_end(scan_t *sc);
+extern void scan_free(scan_t *sc);
+extern bool scan_next(scan_t *sc, span_t *sp);
+extern void align_spans(align_t *a, scan_t *sc);
+extern int  align_scan(align_t *a, scan_t *sc);
+
+// ==================== Native word diff
+
+/*
+ * A token is a run of spaces, a run of word characters [A-Za-z0-9_],
+ * or any other single byte.  This is the same encoding that
+ * wdiff-align-series used to feed lines to wdiff, one "word" per token.
+ */
+struct token {
+    const char    *str;
+    size_t        len;
+    unsigned long hash;
+};
+
+typedef struct token token_t;
+
+// By default, a common prefix or suffix is elided only if it is longer than this.
+
+#define ELIDE_MIN 10
+
+// Diff algorithms.  See word_diff().
+
+#define diff_myers     0
+#define diff_histogram 1
+
+/*
+ * One distinct token of the "before" text, in the histogram
+ * of the region being diffed:  its most recent position,
+ * and how many times it occurs.
+ */
+struct hist_rec {
+    long   pos;
+    size_t count;
+};
+
+typedef struct hist_rec hist_rec_t;
+
+/*
+ * Working storage for word_diff(), the diff algorithm, and the
+ * elision options:  with |ltrim| or |rtrim|, a common prefix
+ * or suffix longer than |elide_min| bytes is shown as "...".
+ * All arrays grow as needed and are reused from one call to the next,
+ * so that diffing a long series of pairs does no allocation
+ * once the largest pair has been seen.
+ *
+ * The histogram diff indexes the "before" tokens of a region in
+ * |headv|, a hash table of indexes + 1 into |recv|;  |nextv| chains
+ * each position to the one before it with the same token, and
+ * |xrecv| gives the record of each position.
+ */
+struct word_diff {
+    bool       ltrim;
+    bool       rtrim;
+    size_t     elide_min;
+    int        algorithm;
+    token_t    *tokv[2];
+    size_t     tokc[2];
+    size_t     toksz[2];
+    char       *chgv[2];
+    size_t     chgsz[2];
+    long       *diagv;
+    size_t     diagsz;
+    size_t     *headv;
+    size_t     headsz;
+    hist_rec_t *recv;
+    size_t     recsz;
+    long       *nextv;
+    size_t     nextsz;
+    size_t     *xrecv;
+    size_t     xrecsz;
+    edit_t     *editv;
+    size_t     editc;
+    size_t     editsz;
+};
+
+typedef struct word_diff word_diff_t;
+
+extern void   word_diff_init(word_diff_t *wd);
+extern void   word_diff_free(word_diff_t *wd);
+extern size_t word_diff(word_diff_t *wd, const char *s1, size_t len1, const char *s2, size_t len2);
+extern void   align_edits(align_t *a, const edit_t *editv, size_t editc);
+
+// ==================== On-disk cache of rendered pairs
+
+/*
+ * A record of the cache file, in the index in memory:
+ * its offset in the file, length of the options and lines it is for,
+ * length of its output, and the run that last used it.
+ */
+struct cache_ent {
+    uint64_t key[2];
+    uint64_t off;
+    size_t   klen;
+    size_t   len;
+    uint64_t used;
+};
+
+typedef struct cache_ent cache_ent_t;
+
+/*
+ * An open cache file.  See cache.c.
+ * The first |maplen| bytes of the file are mapped at |map|;
+ * the file is |size| bytes long, and is capped at |max| bytes.
+ * |slotv| is a hash table of indexes + 1 into |entv|.
+ */
+struct cache {
+    const char  *fname;
+    int         fd;
+    char        *map;
+    size_t      maplen;
+    size_t      size;
+    size_t      max;
+    uint64_t    run;
+    bool        failed;
+    cache_ent_t *entv;
+    size_t      entc;
+    size_t      entsz;
+    size_t      *slotv;
+    size_t      slotsz;
+    char        *kbuf;
+    size_t      klen;
+    size_t      ksz;
+    char        *rbuf;
+    size_t      rsz;
+    size_t      hits;
+    size_t      misses;
+    size_t      stores;
+    size_t      evicted;
+};
+
+typedef struct cache cache_t;
+
+// By default, a cache file is capped at this many bytes.
+
+#define CACHE_MAX (64 * 1024 * 1024)
+
+extern int         cache_open(cache_t *c, const char *fname, size_t max);
+extern void        cache_close(cache_t *c);
+extern void        cache_key(cache_t *c, uint64_t key[2], const char *opts,
+                             const char *s1, size_t len1, const char *s2, size_t len2);
+extern const char *cache_get(cache_t *c, const uint64_t key[2], size_t *lenp);
+extern void        cache_put(cache_t *c, const uint64_t key[2], const char *data, size_t len);
+extern void        cache_print_stats(FILE *f, const cache_t *c);
+
+// ==================== Index of similar lines
+
+// A line's MinHash signature has NEAR_HASHES values, in NEAR_BANDS
+// bands for locality-sensitive hashing;  a bucket keeps NEAR_WAYS lines.
+
+#define NEAR_HASHES 32
+#define NEAR_BANDS  16
+#define NEAR_WAYS   4
+
+/*
+ * A line in the index:  its id, where its text is in the ring of text,
+ * and its signature.  Only the high 16 bits of each MinHash are kept.
+ */
+struct near_ent {
+    uint32_t id;
+    uint32_t len;
+    uint64_t voff;
+    uint16_t sig[NEAR_HASHES];
+};
+
+typedef struct near_ent near_ent_t;
+
+/*
+ * An index of the most recent lines, for finding the earlier line
+ * most like a new one.  See nearest.c.
+ * Text is kept in a ring of |tcap| bytes;  |tend| is the total
+ * ever written.  Lines are kept in a ring of |entc| entries.
+ * |slotv| has |slotc| buckets of NEAR_WAYS line ids each,
+ * most recent first.  |qsig| is the signature of |qline|,
+ * the line last looked up.
+ */
+struct nearest {
+    char       *text;
+    size_t     tcap;
+    uint64_t   tend;
+    near_ent_t *entv;
+    size_t     entc;
+    uint32_t   *slotv;
+    size_t     slotc;
+    uint32_t   next_id;
+    unsigned   min_pct;
+    const char *qline;
+    size_t     qlen;
+    uint16_t   qsig[NEAR_HASHES];
+};
+
+typedef struct nearest nearest_t;
+
+// By default, the index of similar lines takes at most this many bytes,
+// and pairs lines that are at least this similar, in percent.
+
+#define NEAREST_MAX (128 * 1024 * 1024)
+#define NEAREST_MIN 50
+
+extern void        nearest_init(nearest_t *nx, size_t max, unsigned min_pct);
+extern void        nearest_free(nearest_t *nx);
+extern const char *nearest_find(nearest_t *nx, const char *line, size_t len, size_t *lenp);
+extern void        nearest_add(nearest_t *nx, const char *line, size_t len);
+
+// ==================== Series of incremental changes
+
+/*
+ * Each input line is compared with the line before it.
+ * Only the previous line is kept.
+ *
+ * If |cache| is not NULL, the rendered output of each pair is looked
+ * up there first, keyed by |copts|, the options that change it.
+ *
+ * If |near| is not NULL, each line is compared instead with the
+ * most similar of the lines before it, if any is similar enough.
+ */
+struct series {
+    word_diff_t wd;
+    align_t     align;
+    cache_t     *cache;
+    nearest_t   *near;
+    char        copts[128];
+    char        *prev;
+    size_t      prevlen;
+    size_t      prevsz;
+    size_t      ndiffs;
+};
+
+typedef struct series series_t;
+
+extern void series_init(series_t *s, FILE *dstf, bool ltrim, bool rtrim, bool color);
+extern void series_free(series_t *s);
+extern void series_line(series_t *s, const char *line, size_t len);
+extern void series_seed(series_t *s, const char *line, size_t len);
+extern int  series_align(series_t *s, FILE *srcf);
+extern int  series_follow(series_t *s, const char *fname);
+
+#endif  /* _WDIFF_ALIGN_H */
@@ -0,0 +1,842 @@
+/*
+ * Filename: src/cmd/word-diff.c
+ * Project: wdiff-align
+ * Brief: Native word diff, so that wdiff-align need not run wdiff
+ *
+ * Description:
+ *   Split two texts into tokens, find a shortest edit script
+ *   using the O(ND) algorithm of Eugene W. Myers, "An O(ND)
+ *   Difference Algorithm and Its Variations", Algorithmica 1(2), 1986,
+ *   in its linear-space form (find the middle snake, then recurse),
+ *   and express the result as a list of runs of unchanged, deleted
+ *   and inserted text.
+ *
+ *   Or, optionally, use the histogram diff of git and JGit, which
+ *   anchors on the rarest common tokens first, and falls back
+ *   to the Myers diff where there are none.  On long lines with many
+ *   repeated tokens, such as punctuation, it is faster, and it gives
+ *   fewer, longer runs of changes.
+ *
+ *   The edit script can be fed directly to the three-line renderer,
+ *   in place of markers parsed from the output of wdiff.
+ *
+ *   Before anything is tokenized, the common prefix and suffix of the
+ *   two texts are found by comparing 16 bytes at a time, and snapped
+ *   back to token boundaries.  Only the middle, where the texts differ,
+ *   is tokenized and diffed;  for a small edit to a long line, that
+ *   is just a few tokens.
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+    // Import type size_t
+#include <stdlib.h>
+    // Import free()
+    // Import labs()
+#include <stdint.h>
+    // Import type uint64_t
+#include <string.h>
+    // Import memcmp()
+    // Import memcpy()
+    // Import memset()
+
+#include <cscript.h>
+#include "wdiff-align.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/*
+ * The split point found by find_middle_snake().
+ */
+struct partition {
+    long xmid;
+    long ymid;
+};
+
+typedef struct partition partition_t;
+
+static inline bool
+is_word_char(int c)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_');
+}
+
+static inline unsigned long
+hash_bytes(const char *str, size_t len)
+{
+    unsigned long h = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        h = (h ^ (str[i] & 0xff)) * 16777619UL;
+    }
+    return (h ^ len);
+}
+
+/*
+ * Make sure that |vec| has room for at least |nelem| elements
+ * of size |elsz|.  Grow geometrically, so that repeated calls
+ * with slowly increasing sizes do not cost much.
+ */
+static void *
+vec_reserve(void *vec, size_t *szp, size_t nelem, size_t elsz)
+{
+    size_t nsz;
+
+    if (nelem <= *szp) {
+        return (vec);
+    }
+    nsz = *szp ? *szp : 64;
+    while (nsz < nelem) {
+        nsz *= 2;
+    }
+    *szp = nsz;
+    return (guard_realloc(vec, nsz * elsz));
+}
+
+/*
+ * Split |str| into tokens:  a run of spaces, a run of word characters,
+ * or any other single character.  A UTF-8 sequence, of up to 4 bytes,
+ * is one character, so that a change never splits one.
+ */
+static void
+tokenize(word_diff_t *wd, int side, const char *str, size_t len)
+{
+    token_t *tokv = wd->tokv[side];
+    size_t tokc = 0;
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t end = pos + 1;
+        int c = str[pos];
+
+        if (c == ' ') {
+            while (end < len && str[end] == ' ') {
+                ++end;
+            }
+        }
+        else if (is_word_char(c)) {
+            while (end < len && is_word_char(str[end])) {
+                ++end;
+            }
+        }
+        else if ((c & 0xC0) == 0xC0) {
+            while (end < len && end - pos < 4 && (str[end] & 0xC0) == 0x80) {
+                ++end;
+            }
+        }
+
+        if (tokc >= wd->toksz[side]) {
+            tokv = vec_reserve(tokv, &wd->toksz[side], tokc + 1, sizeof (token_t));
+        }
+        tokv[tokc].str  = str + pos;
+        tokv[tokc].len  = end - pos;
+        tokv[tokc].hash = hash_bytes(str + pos, end - pos);
+        ++tokc;
+        pos = end;
+    }
+
+    wd->tokv[side] = tokv;
+    wd->tokc[side] = tokc;
+}
+
+static inline bool
+tok_eq(const token_t *t1, const token_t *t2)
+{
+    return (t1->hash == t2->hash && t1->len == t2->len &&
+            memcmp(t1->str, t2->str, t1->len) == 0);
+}
+
+/*
+ * Find the midpoint of a shortest edit script for the sub-problem
+ * x[xoff..xlim), y[yoff..ylim), searching forward from the top-left
+ * and backward from the bottom-right, one edit step at a time,
+ * until the two searches overlap on some diagonal.
+ *
+ * |fd| and |bd| are indexed by diagonal, k = x - y.
+ */
+static void
+find_middle_snake(const token_t *xv, long xoff, long xlim,
+                  const token_t *yv, long yoff, long ylim,
+                  long *fd, long *bd, partition_t *part)
+{
+    const long dmin = xoff - ylim;
+    const long dmax = xlim - yoff;
+    const long fmid = xoff - yoff;
+    const long bmid = xlim - ylim;
+    long fmin = fmid, fmax = fmid;
+    long bmin = bmid, bmax = bmid;
+    bool odd = (fmid - bmid) & 1;
+
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+
+    while (true) {
+        long d;
+
+        // Extend the forward search by one edit step on each diagonal.
+        if (fmin > dmin) {
+            fd[--fmin - 1] = -1;
+        }
+        else {
+            ++fmin;
+        }
+        if (fmax < dmax) {
+            fd[++fmax + 1] = -1;
+        }
+        else {
+            --fmax;
+        }
+        for (d = fmax; d >= fmin; d -= 2) {
+            long tlo = fd[d - 1];
+            long thi = fd[d + 1];
+            long x = tlo < thi ? thi : tlo + 1;
+            long y = x - d;
+
+            while (x < xlim && y < ylim && tok_eq(&xv[x], &yv[y])) {
+                ++x;
+                ++y;
+            }
+            fd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+                part->xmid = x;
+                part->ymid = y;
+                return;
+            }
+        }
+
+        // Extend the backward search by one edit step on each diagonal.
+        if (bmin > dmin) {
+            bd[--bmin - 1] = xlim + 1;
+        }
+        else {
+            ++bmin;
+        }
+        if (bmax < dmax) {
+            bd[++bmax + 1] = xlim + 1;
+        }
+        else {
+            --bmax;
+        }
+        for (d = bmax; d >= bmin; d -= 2) {
+            long tlo = bd[d - 1];
+            long thi = bd[d + 1];
+            long x = tlo < thi ? tlo : thi - 1;
+            long y = x - d;
+
+            while (x > xoff && y > yoff && tok_eq(&xv[x - 1], &yv[y - 1])) {
+                --x;
+                --y;
+            }
+            bd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+                part->xmid = x;
+                part->ymid = y;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Mark the tokens of x[xoff..xlim) and y[yoff..ylim) that are
+ * not part of a longest common subsequence as changed.
+ */
+static void
+compare_seq(word_diff_t *wd, long xoff, long xlim, long yoff, long ylim,
+            long *fd, long *bd)
+{
+    const token_t *xv = wd->tokv[0];
+    const token_t *yv = wd->tokv[1];
+
+    // Slide down the common prefix, and up the common suffix.
+    while (xoff < xlim && yoff < ylim && tok_eq(&xv[xoff], &yv[yoff])) {
+        ++xoff;
+        ++yoff;
+    }
+    while (xlim > xoff && ylim > yoff && tok_eq(&xv[xlim - 1], &yv[ylim - 1])) {
+        --xlim;
+        --ylim;
+    }
+
+    if (xoff == xlim) {
+        memset(wd->chgv[1] + yoff, 1, ylim - yoff);
+    }
+    else if (yoff == ylim) {
+        memset(wd->chgv[0] + xoff, 1, xlim - xoff);
+    }
+    else {
+        partition_t part;
+
+        find_middle_snake(xv, xoff, xlim, yv, yoff, ylim, fd, bd, &part);
+        compare_seq(wd, xoff, part.xmid, yoff, part.ymid, fd, bd);
+        compare_seq(wd, part.xmid, xlim, part.ymid, ylim, fd, bd);
+    }
+}
+
+// A token that occurs more often than this in a region is never an anchor.
+
+#define MAX_CHAIN 64
+
+/*
+ * An anchor for the histogram diff:  x[xs..xe) is the same as y[ys..ye),
+ * and the rarest of its tokens occurs |count| times in the region of x.
+ */
+struct anchor {
+    long   xs, xe;
+    long   ys, ye;
+    size_t count;
+};
+
+typedef struct anchor anchor_t;
+
+/*
+ * Index the tokens of x[xoff..xlim):  one record per distinct token,
+ * with the chain of its positions, most recent first.
+ * Return the mask of the hash table.
+ */
+static size_t
+hist_index(word_diff_t *wd, long xoff, long xlim)
+{
+    const token_t *xv = wd->tokv[0];
+    size_t tsz;
+    size_t nrec = 0;
+    long x;
+
+    tsz = 16;
+    while (tsz < 2 * (size_t)(xlim - xoff)) {
+        tsz *= 2;
+    }
+    wd->headv = vec_reserve(wd->headv, &wd->headsz, tsz, sizeof (size_t));
+    memset(wd->headv, 0, tsz * sizeof (size_t));
+
+    for (x = xoff; x < xlim; ++x) {
+        size_t h = xv[x].hash & (tsz - 1);
+        size_t r;
+
+        while ((r = wd->headv[h]) != 0 && !tok_eq(&xv[wd->recv[r - 1].pos], &xv[x])) {
+            h = (h + 1) & (tsz - 1);
+        }
+        if (r == 0) {
+            wd->recv[nrec].pos = -1;
+            wd->recv[nrec].count = 0;
+            wd->headv[h] = r = ++nrec;
+        }
+        wd->nextv[x] = wd->recv[r - 1].pos;
+        wd->recv[r - 1].pos = x;
+        ++wd->recv[r - 1].count;
+        wd->xrecv[x] = r - 1;
+    }
+    return (tsz - 1);
+}
+
+/*
+ * The record of token |tok| in the index, or -1 if it is not there.
+ */
+static long
+hist_lookup(const word_diff_t *wd, size_t mask, const token_t *tok)
+{
+    const token_t *xv = wd->tokv[0];
+    size_t h = tok->hash & mask;
+    size_t r;
+
+    while ((r = wd->headv[h]) != 0) {
+        if (tok_eq(&xv[wd->recv[r - 1].pos], tok)) {
+            return (r - 1);
+        }
+        h = (h + 1) & mask;
+    }
+    return (-1);
+}
+
+/*
+ * Find the best anchor in x[xoff..xlim), y[yoff..ylim):  the run of
+ * common tokens whose rarest token is rarest in x, and among those,
+ * the longest, and among those, the one nearest the middle of x.
+ * Each occurrence of a token in y is tried against each of its
+ * occurrences in x, and grown in both directions.
+ *
+ * The region is indexed and scanned again on each side of the anchor,
+ * so an anchor at one end of it, taken when many are as good, as
+ * on a long line with evenly spaced changes, would make the histogram
+ * diff quadratic.  From the middle, the depth is logarithmic.
+ *
+ * Return 1 if there is an anchor;  0 if the regions have no token
+ * in common;  or -1 if all the common tokens are too frequent.
+ */
+static int
+find_anchor(word_diff_t *wd, long xoff, long xlim, long yoff, long ylim,
+            anchor_t *best)
+{
+    const token_t *xv = wd->tokv[0];
+    const token_t *yv = wd->tokv[1];
+    const hist_rec_t *recv = wd->recv;
+    size_t mask;
+    long bestdist = 0;
+    bool common = false;
+    bool found = false;
+    long y;
+
+    mask = hist_index(wd, xoff, xlim);
+    best->count = MAX_CHAIN;
+    best->xs = best->xe = 0;
+
+    y = yoff;
+    while (y < ylim) {
+        long ynext = y + 1;
+        long r = hist_lookup(wd, mask, &yv[y]);
+        long x;
+
+        if (r >= 0) {
+            common = true;
+        }
+        if (r < 0 || recv[r].count > best->count) {
+            y = ynext;
+            continue;
+        }
+
+        for (x = recv[r].pos; x >= 0; x = wd->nextv[x]) {
+            long xs = x, ys = y;
+            long xe = x + 1, ye = y + 1;
+            size_t count = recv[r].count;
+            long dist;
+
+            while (xs > xoff && ys > yoff && tok_eq(&xv[xs - 1], &yv[ys - 1])) {
+                --xs;
+                --ys;
+                if (recv[wd->xrecv[xs]].count < count) {
+                    count = recv[wd->xrecv[xs]].count;
+                }
+            }
+            while (xe < xlim && ye < ylim && tok_eq(&xv[xe], &yv[ye])) {
+                if (recv[wd->xrecv[xe]].count < count) {
+                    count = recv[wd->xrecv[xe]].count;
+                }
+                ++xe;
+                ++ye;
+            }
+
+            // Tokens of y within this run need not be tried again.
+            if (ye > ynext) {
+                ynext = ye;
+            }
+            dist = labs((xs + xe) - (xoff + xlim));
+            if (xe - xs > best->xe - best->xs || count < best->count
+                || (xe - xs == best->xe - best->xs && count == best->count
+                    && dist < bestdist)) {
+                bestdist = dist;
+                best->xs = xs;
+                best->xe = xe;
+                best->ys = ys;
+                best->ye = ye;
+                best->count = count;
+                found = true;
+            }
+        }
+        y = ynext;
+    }
+
+    return (found ? 1 : common ? -1 : 0);
+}
+
+/*
+ * Same as compare_seq(), but with the histogram diff, as in git and
+ * JGit:  anchor on the rarest run of common tokens, and recurse
+ * on each side of it.  Frequent tokens, such as punctuation, do not
+ * pair up on their own across unrelated parts of the texts, and the
+ * cost on input with many repeated tokens stays close to linear.
+ * A region where all the common tokens are frequent is left
+ * to the Myers diff.
+ */
+static void
+histogram_seq(word_diff_t *wd, long xoff, long xlim, long yoff, long ylim,
+              long *fd, long *bd)
+{
+    const token_t *xv = wd->tokv[0];
+    const token_t *yv = wd->tokv[1];
+
+    while (true) {
+        anchor_t best;
+        int rv;
+
+        while (xoff < xlim && yoff < ylim && tok_eq(&xv[xoff], &yv[yoff])) {
+            ++xoff;
+            ++yoff;
+        }
+        while (xlim > xoff && ylim > yoff && tok_eq(&xv[xlim - 1], &yv[ylim - 1])) {
+            --xlim;
+            --ylim;
+        }
+        if (xoff == xlim || yoff == ylim) {
+            memset(wd->chgv[0] + xoff, 1, xlim - xoff);
+            memset(wd->chgv[1] + yoff, 1, ylim - yoff);
+            return;
+        }
+
+        rv = find_anchor(wd, xoff, xlim, yoff, ylim, &best);
+        if (rv == 0) {
+            memset(wd->chgv[0] + xoff, 1, xlim - xoff);
+            memset(wd->chgv[1] + yoff, 1, ylim - yoff);
+            return;
+        }
+        if (rv < 0) {
+            compare_seq(wd, xoff, xlim, yoff, ylim, fd, bd);
+            return;
+        }
+
+        // Recurse on the left;  loop on the right.
+        histogram_seq(wd, xoff, best.xs, yoff, best.ys, fd, bd);
+        xoff = best.xe;
+        yoff = best.ye;
+    }
+}
+
+static void
+push_edit(word_diff_t *wd, int op, const char *text, size_t len)
+{
+    size_t editc = wd->editc;
+
+    if (editc >= wd->editsz) {
+        wd->editv = vec_reserve(wd->editv, &wd->editsz, editc + 1, sizeof (edit_t));
+    }
+    wd->editv[editc].op = op;
+    wd->editv[editc].text = text;
+    wd->editv[editc].len = len;
+    wd->editc = editc + 1;
+}
+
+/*
+ * Walk the changed flags of both sides in step,
+ * and collect maximal runs of unchanged, deleted and inserted tokens.
+ * Tokens are contiguous in the original text, so each run
+ * is a single span of text.
+ */
+static void
+build_edit_script(word_diff_t *wd, size_t x, size_t xc, size_t y, size_t yc)
+{
+    const token_t *xv = wd->tokv[0];
+    const token_t *yv = wd->tokv[1];
+    const char *xchg = wd->chgv[0];
+    const char *ychg = wd->chgv[1];
+
+    while (x < xc || y < yc) {
+        size_t start;
+
+        if (x < xc && y < yc && !xchg[x] && !ychg[y]) {
+            start = x;
+            while (x < xc && y < yc && !xchg[x] && !ychg[y]) {
+                ++x;
+                ++y;
+            }
+            push_edit(wd, ' ', xv[start].str,
+                      xv[x - 1].str + xv[x - 1].len - xv[start].str);
+            continue;
+        }
+
+        start = x;
+        while (x < xc && xchg[x]) {
+            ++x;
+        }
+        if (x > start) {
+            push_edit(wd, '-', xv[start].str,
+                      xv[x - 1].str + xv[x - 1].len - xv[start].str);
+        }
+
+        start = y;
+        while (y < yc && ychg[y]) {
+            ++y;
+        }
+        if (y > start) {
+            push_edit(wd, '+', yv[start].str,
+                      yv[y - 1].str + yv[y - 1].len - yv[start].str);
+        }
+    }
+}
+
+/*
+ * Length of the common prefix of |p1| and |p2|, which are both
+ * at least |n| bytes long.
+ */
+static size_t
+common_prefix(const char *p1, const char *p2, size_t n)
+{
+    size_t i = 0;
+
+#ifdef HAVE_X86_SIMD
+    while (i + 16 <= n) {
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(p2 + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) ^ 0xFFFF;
+
+        if (mask != 0) {
+            return (i + __builtin_ctz(mask));
+        }
+        i += 16;
+    }
+#endif
+    while (i + 8 <= n) {
+        uint64_t w1, w2;
+
+        memcpy(&w1, p1 + i, 8);
+        memcpy(&w2, p2 + i, 8);
+        if (w1 != w2) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < n && p1[i] == p2[i]) {
+        ++i;
+    }
+    return (i);
+}
+
+/*
+ * Length of the common suffix of the |n| bytes that end at |e1|
+ * and at |e2|.
+ */
+static size_t
+common_suffix(const char *e1, const char *e2, size_t n)
+{
+    size_t i = 0;
+
+#ifdef HAVE_X86_SIMD
+    while (i + 16 <= n) {
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(e1 - i - 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(e2 - i - 16));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) ^ 0xFFFF;
+
+        if (mask != 0) {
+            // The last mismatch is the highest bit set.
+            return (i + __builtin_clz(mask) - 16);
+        }
+        i += 16;
+    }
+#endif
+    while (i + 8 <= n) {
+        uint64_t w1, w2;
+
+        memcpy(&w1, e1 - i - 8, 8);
+        memcpy(&w2, e2 - i - 8, 8);
+        if (w1 != w2) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < n && e1[-(long)i - 1] == e2[-(long)i - 1]) {
+        ++i;
+    }
+    return (i);
+}
+
+/*
+ * Does a token start at |pos| in |str|?  That is the case, unless
+ * the bytes on either side of |pos| would be put in the same token
+ * by tokenize():  two spaces, two word characters, or a UTF-8
+ * continuation byte in a sequence that started at most 3 bytes
+ * before |pos|.
+ */
+static bool
+is_token_start(const char *str, size_t len, size_t pos)
+{
+    int c0, c1;
+    size_t i;
+
+    if (pos == 0 || pos >= len) {
+        return (true);
+    }
+    c0 = str[pos - 1];
+    c1 = str[pos];
+    if (c0 == ' ' && c1 == ' ') {
+        return (false);
+    }
+    if (is_word_char(c0) && is_word_char(c1)) {
+        return (false);
+    }
+    if ((c1 & 0xC0) != 0x80) {
+        return (true);
+    }
+    for (i = pos; i > 0 && pos - i < 3; --i) {
+        int c = str[i - 1];
+
+        if ((c & 0xC0) == 0xC0) {
+            return (false);
+        }
+        if ((c & 0xC0) != 0x80) {
+            return (true);
+        }
+    }
+    return (true);
+}
+
+void
+word_diff_init(word_diff_t *wd)
+{
+    memset(wd, 0, sizeof (*wd));
+    wd->elide_min = ELIDE_MIN;
+}
+
+void
+word_diff_free(word_diff_t *wd)
+{
+    free(wd->tokv[0]);
+    free(wd->tokv[1]);
+    free(wd->chgv[0]);
+    free(wd->chgv[1]);
+    free(wd->diagv);
+    free(wd->headv);
+    free(wd->recv);
+    free(wd->nextv);
+    free(wd->xrecv);
+    free(wd->editv);
+    word_diff_init(wd);
+}
+
+/**
+ * @brief Compute a word-level edit script that transforms |s1| into |s2|.
+ * @param wd    IN/OUT  Reusable working storage; holds the result.
+ * @param s1    IN      The "before" text.
+ * @param len1  IN      Length of |s1|.
+ * @param s2    IN      The "after" text.
+ * @param len2  IN      Length of |s2|.
+ * @return The number of edits in |wd->editv|.
+ *
+ * The edit script points into |s1| and |s2|, which must stay
+ * valid for as long as the edit script is in use.
+ *
+ * If |wd->ltrim| is set, a common prefix longer than |wd->elide_min|
+ * bytes is replaced by "... ";  likewise, |wd->rtrim| replaces a long
+ * common suffix by " ...".
+ *
+ * The tokens are diffed with the Myers diff, or, if |wd->algorithm|
+ * is diff_histogram, with the histogram diff.
+ */
+size_t
+word_diff(word_diff_t *wd, const char *s1, size_t len1, const char *s2, size_t len2)
+{
+    size_t xc, yc;
+    size_t pre, suf;
+    size_t n;
+    long *fd, *bd;
+
+    /*
+     * Find the common prefix, and then the common suffix of what is
+     * left, both snapped back to where a token starts in both texts.
+     * The tokens of the common prefix are then the same in both texts,
+     * as are those of the common suffix.
+     */
+    n = len1 < len2 ? len1 : len2;
+    pre = common_prefix(s1, s2, n);
+    while (!is_token_start(s1, len1, pre) || !is_token_start(s2, len2, pre)) {
+        --pre;
+    }
+    suf = common_suffix(s1 + len1, s2 + len2, n - pre);
+    while (!is_token_start(s1, len1, len1 - suf)
+           || !is_token_start(s2, len2, len2 - suf)) {
+        --suf;
+    }
+
+    tokenize(wd, 0, s1 + pre, len1 - pre - suf);
+    tokenize(wd, 1, s2 + pre, len2 - pre - suf);
+    xc = wd->tokc[0];
+    yc = wd->tokc[1];
+
+    wd->chgv[0] = vec_reserve(wd->chgv[0], &wd->chgsz[0], xc + 1, 1);
+    wd->chgv[1] = vec_reserve(wd->chgv[1], &wd->chgsz[1], yc + 1, 1);
+    memset(wd->chgv[0], 0, xc + 1);
+    memset(wd->chgv[1], 0, yc + 1);
+
+    // Diagonals range from -(yc + 1) to xc + 1, in each direction.
+    wd->diagv = vec_reserve(wd->diagv, &wd->diagsz, 2 * (xc + yc + 3), sizeof (long));
+    fd = wd->diagv + yc + 1;
+    bd = wd->diagv + (xc + yc + 3) + yc + 1;
+
+    if (wd->algorithm == diff_histogram) {
+        wd->recv = vec_reserve(wd->recv, &wd->recsz, xc + 1, sizeof (hist_rec_t));
+        wd->nextv = vec_reserve(wd->nextv, &wd->nextsz, xc + 1, sizeof (long));
+        wd->xrecv = vec_reserve(wd->xrecv, &wd->xrecsz, xc + 1, sizeof (size_t));
+        histogram_seq(wd, 0, xc, 0, yc, fd, bd);
+    }
+    else {
+        compare_seq(wd, 0, xc, 0, yc, fd, bd);
+    }
+
+    /*
+     * Optionally, replace a long common prefix and/or suffix
+     * by an ellipsis.
+     */
+    wd->editc = 0;
+    if (wd->ltrim && pre > wd->elide_min) {
+        push_edit(wd, ' ', "... ", 4);
+    }
+    else if (pre != 0) {
+        push_edit(wd, ' ', s1, pre);
+    }
+    build_edit_script(wd, 0, xc, 0, yc);
+    if (wd->rtrim && suf > wd->elide_min) {
+        push_edit(wd, ' ', " ...", 4);
+    }
+    else if (suf != 0) {
+        push_edit(wd, ' ', s1 + len1 - suf, suf);
+    }
+    return (wd->editc);
+}
+
+/**
+ * @brief Feed an edit script to the three-line renderer.
+ * @param a      IN  The renderer.
+ * @param editv  IN  Array of edits, as computed by word_diff().
+ * @param editc  IN  Number of edits.
+ * @return void
+ *
+ * This produces the same events that would result from parsing
+ * the output of wdiff for the same two texts.
+ */
+void
+align_edits(align_t *a, const edit_t *editv, size_t editc)
+{
+    size_t i;
+
+    for (i = 0; i < editc; ++i) {
+        const edit_t *e = &editv[i];
+
+        switch (e->op) {
+        case '-':
+            align_marker(a, delete_start);
+            align_text(a, e->text, e->len);
+            align_marker(a, delete_end);
+            break;
+        case '+':
+            align_marker(a, insert_start);
+            align_text(a, e->text, e->len);
+            align_marker(a, insert_end);
+            break;
+        default:
+            align_text(a, e->text, e->len);
+            break;
+        }
+    }
+}
@@ -134,9 +134,25 @@ extern void   dbg_show_svar(const char *var, const char *value);
 extern void * guard_malloc(size_t sz);
 extern void * guard_calloc(size_t nelem, size_t sz);
 extern void * guard_realloc(void *mem, size_t sz);
-extern void   fexpain_err(FILE *f, int err);
-extern void   eexpain_err(int err);
-extern void   expain_err(int err);
+
+/*
+ * A handler for a failed guard_*() allocation, in place of exiting.
+ * Handlers are kept per thread, as a stack;  the innermost is popped
+ * and called, and must not return, but leave by longjmp().
+ */
+struct guard_oom {
+    void             (*fn)(void *arg);
+    void             *arg;
+    struct guard_oom *prev;
+};
+
+typedef struct guard_oom guard_oom_t;
+
+extern void   guard_push_oom(guard_oom_t *h);
+extern void   guard_pop_oom(guard_oom_t *h);
+extern void   fexplain_err(FILE *f, int err);
+extern void   eexplain_err(int err);
+extern void   explain_err(int err);
 extern int    file_test(const char *tests, const char *fname);
 
 // Note: msg is _not_ of type @type{const char *}, because the message
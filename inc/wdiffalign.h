@@ -0,0 +1,144 @@
+/*
+ * Filename: src/inc/wdiffalign.h
+ * Project: wdiff-align
+ * Brief: Public interface to libwdiffalign
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WDIFFALIGN_H
+#define _WDIFFALIGN_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * All state is kept in a context, wda_t.  There is no global state,
+ * so any number of contexts can be used at once, on any number of
+ * threads, as long as each context is used by one thread at a time.
+ *
+ * Input is pushed to a context, a piece at a time, in any size of
+ * pieces;  a marker can be split across two pieces.  Aligned output
+ * is delivered to a sink, in batches, as soon as it is ready.
+ *
+ * Buffers grow to fit the longest line seen, and are kept for as
+ * long as the context is, so a context that is reused for many
+ * requests does no allocation once it has warmed up.
+ *
+ * If memory runs out, wda_new() returns NULL, and wda_push(),
+ * wda_finish() and wda_diff() return WDA_ENOMEM;  nothing is printed,
+ * and the process goes on.  A context that has run out of memory
+ * returns WDA_ENOMEM from then on, and can only be freed.
+ */
+
+typedef struct wda wda_t;
+
+// Returned when memory runs out
+
+#define WDA_ENOMEM ENOMEM
+
+/*
+ * Receives aligned output.  |buf| is valid only during the call.
+ */
+typedef void (*wda_sink_fn)(void *arg, const char *buf, size_t len);
+
+/*
+ * Receives a warning, such as inserting and deleting at the same time.
+ */
+typedef void (*wda_warn_fn)(void *arg, const char *msg);
+
+/*
+ * Rendering options.
+ *
+ * |markers| are the start insert, end insert, start delete and
+ * end delete markers used by wdiff;  any that are NULL get the
+ * default for |ctrl|, as with the wdiff-align options.
+ *
+ * If |fold| is not 0, lines are shown in bands of |fold| columns,
+ * as with --fold.  If |fine| is set, changed word pairs are diffed
+ * character by character, as with --fine.
+ */
+struct wda_options {
+    bool       ctrl;
+    bool       color;
+    bool       show_midline;
+    size_t     fold;
+    bool       fine;
+    const char *markers[4];
+};
+
+typedef struct wda_options wda_options_t;
+
+extern void        wda_options_default(wda_options_t *opt);
+extern wda_t *     wda_new(const wda_options_t *opt, const char **emsgp);
+extern void        wda_free(wda_t *ctx);
+extern void        wda_set_sink(wda_t *ctx, wda_sink_fn sink, void *arg);
+extern void        wda_set_warn(wda_t *ctx, wda_warn_fn warn, void *arg);
+extern int         wda_push(wda_t *ctx, const void *buf, size_t len);
+extern int         wda_finish(wda_t *ctx);
+extern int         wda_diff(wda_t *ctx, const char *s1, size_t len1, const char *s2, size_t len2);
+
+// ==================== Server protocol
+
+/*
+ * Requests to 'wdiff-align --serve SOCKET', over a Unix stream socket.
+ * A connection can carry any number of requests, one after another.
+ *
+ * A request is a header of four 32-bit words, in network byte order:
+ *   type    WDA_REQ_WDIFF or WDA_REQ_DIFF
+ *   flags   any of WDA_OPT_*
+ *   len1    length of the first text
+ *   len2    length of the second text;  0 for WDA_REQ_WDIFF
+ * followed by the texts.  For WDA_REQ_WDIFF, the first text is the
+ * output of wdiff;  for WDA_REQ_DIFF, the texts are "before" and "after".
+ *
+ * The response is a header of three 32-bit words, in network byte order:
+ *   status  WDA_OK, or else the connection is closed after the response
+ *   outlen  length of the aligned output
+ *   warnlen length of any warnings, one per line
+ * followed by the output, and then the warnings.
+ *
+ * WDA_TOO_LARGE is returned for a request longer than the server takes,
+ * and for one whose output or warnings would not fit in 32 bits;
+ * WDA_NO_MEMORY if the server ran out of memory aligning it.
+ * Either way, the response carries no output or warnings.
+ */
+
+#define WDA_REQ_WDIFF   1
+#define WDA_REQ_DIFF    2
+
+#define WDA_OPT_CTRL    0x1
+#define WDA_OPT_MIDLINE 0x2
+#define WDA_OPT_COLOR   0x4
+#define WDA_OPT_FINE    0x8
+#define WDA_OPT_MASK    0xf
+
+#define WDA_OK          0
+#define WDA_BAD_REQUEST 1
+#define WDA_TOO_LARGE   2
+#define WDA_NO_MEMORY   3
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _WDIFFALIGN_H */
@@ -0,0 +1,154 @@
+/*
+ * Filename: guard-malloc.c
+ * Library: libcscript
+ * Brief: malloc(), calloc(), realloc() that never return NULL
+ *
+ * Description:
+ *   Wrappers for the standard memory allocation functions,
+ *   for use in programs that have no sensible way to recover
+ *   from running out of memory.  On failure, an error message
+ *   is written to |errprint_fh| and the program exits.
+ *
+ *   Code that can recover, such as a library called by a program
+ *   that must keep running, pushes a handler for the thread,
+ *   which is called instead, and leaves by longjmp().
+ *
+ * Copyright (C) 2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+    // Import var errno
+#include <stdio.h>
+    // Import fprintf()
+    // Import type FILE
+#include <stdlib.h>
+    // Import calloc()
+    // Import exit()
+    // Import malloc()
+    // Import realloc()
+
+#include <cscript.h>
+
+// The innermost handler of this thread
+
+static __thread guard_oom_t *oom_top;
+
+/**
+ * @brief Call |h| instead of exiting, if an allocation by this thread
+ *        fails, until it is popped.
+ * @param h  IN  The handler;  it must stay valid until it is popped.
+ * @return void
+ */
+void
+guard_push_oom(guard_oom_t *h)
+{
+    h->prev = oom_top;
+    oom_top = h;
+}
+
+/**
+ * @brief Pop |h|, and any handlers pushed after it.
+ * @param h  IN  A handler pushed by guard_push_oom().
+ * @return void
+ *
+ * A handler that has been called is already popped.
+ */
+void
+guard_pop_oom(guard_oom_t *h)
+{
+    guard_oom_t *p;
+
+    for (p = oom_top; p != NULL; p = p->prev) {
+        if (p == h) {
+            oom_top = h->prev;
+            return;
+        }
+    }
+}
+
+static void
+out_of_memory(const char *fname, size_t sz)
+{
+    int err = errno;
+    FILE *f = errprint_fh ? errprint_fh : stderr;
+    guard_oom_t *h = oom_top;
+
+    if (h != NULL) {
+        oom_top = h->prev;
+        h->fn(h->arg);
+    }
+
+    fprintf(f, "%s(%zu) failed.\n", fname, sz);
+    fexplain_err(f, err);
+    exit(2);
+}
+
+/**
+ * @brief Allocate memory, like malloc(), but never return NULL.
+ * @param sz  IN  Number of bytes to allocate.
+ * @return Pointer to the new memory.
+ *
+ */
+void *
+guard_malloc(size_t sz)
+{
+    void *mem;
+
+    mem = malloc(sz);
+    if (mem == NULL) {
+        out_of_memory("malloc", sz);
+    }
+    return (mem);
+}
+
+/**
+ * @brief Allocate zeroed memory, like calloc(), but never return NULL.
+ * @param nelem  IN  Number of elements.
+ * @param sz     IN  Size of each element.
+ * @return Pointer to the new memory.
+ *
+ */
+void *
+guard_calloc(size_t nelem, size_t sz)
+{
+    void *mem;
+
+    mem = calloc(nelem, sz);
+    if (mem == NULL) {
+        out_of_memory("calloc", nelem * sz);
+    }
+    return (mem);
+}
+
+/**
+ * @brief Resize memory, like realloc(), but never return NULL.
+ * @param mem  IN  Memory previously allocated, or NULL.
+ * @param sz   IN  New size, in bytes.
+ * @return Pointer to the resized memory.
+ *
+ */
+void *
+guard_realloc(void *mem, size_t sz)
+{
+    void *nmem;
+
+    nmem = realloc(mem, sz);
+    if (nmem == NULL) {
+        out_of_memory("realloc", sz);
+    }
+    return (nmem);
+}